@@ -8,41 +8,392 @@
 
 #include "XrdCl/XrdClUtils.hh"
 #include "XrdProxyPrefix.hh"
+#include "XrdProxyPrefixBlockCache.hh"
+#include "XrdProxyPrefixBypass.hh"
+#include "XrdProxyPrefixDiskCache.hh"
+#include "XrdProxyPrefixHandlePool.hh"
+#include "XrdProxyPrefixMetaCache.hh"
+#include "XrdProxyPrefixNegCache.hh"
+#include "XrdProxyPrefixStatBatch.hh"
+#include "XrdProxyPrefixStats.hh"
+#include "XrdProxyPrefixWriteBehind.hh"
+#include "XrdProxyPrefixProxies.hh"
+#include "XrdProxyPrefixReadAhead.hh"
+#include <algorithm>
 #include <assert.h>
+#include <cctype>
 #include <cstdlib>
+#include <cstring>
 #include <exception>
+#include <map>
+#include <mutex>
+#include <numeric>
 #include <string>
 #include <utility>
+#include <vector>
 using namespace XrdCl;
 XrdVERSIONINFO(XrdClGetPlugIn, ProxyPrefix);
 
 namespace ProxyPrefix {
 enum Mode { Local, Default, Undefined };
-class ProxyPrefixFile : public XrdCl::FilePlugIn {
+
+//----------------------------------------------------------------------------
+// The protocol of the url as XrdCl::URL parses it, without copying
+//----------------------------------------------------------------------------
+static const char* urlProtocol(const std::string& url, size_t& length) {
+    size_t pos = url.find("://");
+    if (pos != std::string::npos) {
+        length = pos;
+        return url.data();
+    }
+    const char* protocol = "root";
+    if (!url.empty() && url[0] == '/')
+        protocol = "file";
+    else if (!url.empty() && url[0] == '-')
+        protocol = "stdio";
+    length = strlen(protocol);
+    return protocol;
+}
+
+//----------------------------------------------------------------------------
+// Collects the responses of the vector reads a coalesced VectorRead was split
+// into, scatters the data back into the caller's chunks and notifies the
+// caller once the last response arrived
+//----------------------------------------------------------------------------
+class VectorReadCollector : public XrdCl::ResponseHandler {
   private:
-    static std::string proxyPrefix;
-    XrdCl::File xfile;
+    struct Copy {
+        const char* from;
+        char* to;
+        uint32_t length;
+    };
+    ChunkList userChunks;
+    XrdCl::ResponseHandler* userHandler;
+    std::vector<char*> staging;
+    std::vector<Copy> copies;
+    std::mutex mtx;
+    size_t pending;
+    XRootDStatus* error;
+    HostList* hosts;
+
+    void Done() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (--pending)
+                return;
+        }
+        HostList* hl = hosts ? hosts : new HostList();
+        hosts = 0;
+        if (error) {
+            XRootDStatus* st = error;
+            error = 0;
+            userHandler->HandleResponseWithHosts(st, 0, hl);
+            delete this;
+            return;
+        }
+        for (auto& c : copies)
+            memcpy(c.to, c.from, c.length);
+        VectorReadInfo* info = new VectorReadInfo();
+        uint32_t size = 0;
+        for (auto& c : userChunks) {
+            info->GetChunks().push_back(c);
+            size += c.length;
+        }
+        info->SetSize(size);
+        AnyObject* obj = new AnyObject();
+        obj->Set(info);
+        userHandler->HandleResponseWithHosts(new XRootDStatus(), obj, hl);
+        delete this;
+    }
 
   public:
-    static void setProxyPrefix(std::string toProxyPrefix) { proxyPrefix = toProxyPrefix; }
-    static void printInfo() {
-        XrdCl::Log* log = XrdCl::DefaultEnv::GetLog();
-        std::string ppc = proxyPrefix;
-        log->Debug(1, std::string("XrdProxyPrefix: ").append(ppc).c_str());
+    //------------------------------------------------------------------------
+    // The chunks need to have their destination buffers resolved already
+    //------------------------------------------------------------------------
+    VectorReadCollector(const ChunkList& chunks, XrdCl::ResponseHandler* handler)
+      : userChunks(chunks), userHandler(handler), pending(1), error(0), hosts(0) {}
+
+    ~VectorReadCollector() {
+        for (auto buf : staging)
+            delete[] buf;
+        delete error;
+        delete hosts;
     }
 
-    std::string AddPrefix(std::string url) {
+    //------------------------------------------------------------------------
+    // Sort the chunks, merge the ones closer than gap bytes into a staging
+    // buffer and split the result into requests the server accepts
+    //------------------------------------------------------------------------
+    std::vector<ChunkList> Plan(uint32_t gap, uint32_t maxChunks, uint32_t maxChunkSize) {
+        std::vector<size_t> order(userChunks.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+            return userChunks[a].offset < userChunks[b].offset;
+        });
+
+        ChunkList merged;
+        size_t first = 0;
+        while (first < order.size()) {
+            const ChunkInfo& head = userChunks[order[first]];
+            uint64_t start = head.offset;
+            uint64_t end = head.offset + head.length;
+            size_t last = first + 1;
+            for (; last < order.size(); ++last) {
+                const ChunkInfo& c = userChunks[order[last]];
+                uint64_t cend = std::max(end, c.offset + c.length);
+                if (c.offset > end + gap || cend - start > maxChunkSize)
+                    break;
+                end = cend;
+            }
+
+            if (last - first == 1) {
+                // nothing to merge with, read straight into the user buffer
+                for (uint64_t off = 0; off < head.length; off += maxChunkSize) {
+                    uint32_t len = std::min<uint64_t>(maxChunkSize, head.length - off);
+                    merged.push_back(
+                      ChunkInfo(head.offset + off, len, static_cast<char*>(head.buffer) + off));
+                }
+            } else {
+                char* buf = new char[end - start];
+                staging.push_back(buf);
+                merged.push_back(ChunkInfo(start, end - start, buf));
+                for (size_t i = first; i < last; ++i) {
+                    const ChunkInfo& c = userChunks[order[i]];
+                    Copy cp = { buf + (c.offset - start), static_cast<char*>(c.buffer), c.length };
+                    copies.push_back(cp);
+                }
+            }
+            first = last;
+        }
+
+        std::vector<ChunkList> requests;
+        for (size_t i = 0; i < merged.size(); i += maxChunks)
+            requests.push_back(ChunkList(merged.begin() + i,
+                                         merged.begin() + std::min<size_t>(i + maxChunks,
+                                                                           merged.size())));
+        return requests;
+    }
+
+    bool Coalesced() const { return !staging.empty(); }
+
+    //------------------------------------------------------------------------
+    // Send all the requests, the collector deletes itself when done
+    //------------------------------------------------------------------------
+    XRootDStatus Send(XrdCl::File& file, const std::vector<ChunkList>& requests,
+                      uint16_t timeout) {
+        pending += requests.size();
+        XRootDStatus st;
+        size_t sent = 0;
+        for (; sent < requests.size(); ++sent) {
+            st = file.VectorRead(requests[sent], 0, this, timeout);
+            if (!st.IsOK())
+                break;
+        }
+        if (sent == 0 && !st.IsOK()) {
+            delete this;
+            return st;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            pending -= requests.size() - sent;
+            if (!st.IsOK() && !error)
+                error = new XRootDStatus(st);
+        }
+        Done();
+        return XRootDStatus();
+    }
+
+    virtual void HandleResponseWithHosts(XRootDStatus* status, AnyObject* response,
+                                         HostList* hostList) {
+        delete response;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (!status->IsOK() && !error)
+                std::swap(error, status);
+            if (hostList)
+                std::swap(hosts, hostList);
+        }
+        delete status;
+        delete hostList;
+        Done();
+    }
+};
+
+class ProxyPrefixFile : public XrdCl::FilePlugIn {
+  private:
+    static uint32_t vectorReadGap;
+    static uint32_t vectorReadMaxChunks;
+    static uint32_t vectorReadMaxChunkSize;
+    static uint32_t openRetries;
+    std::unique_ptr<XrdCl::File> xfile;
+    WriteBehind writeBehind;
+    DiskCacheSource source;
+    ReadAhead readAhead;
+    BlockCache* blockCache;
+    FetchTracker fetches;
+    std::string location;
+    ProxyList* proxies;
+    BypassRules* bypass;
+    MetadataCache* metaCache;
+    NegativeCache* negCache;
+    std::string metaKey; //< key of the path in the metadata and negative caches
+    bool modified; //< written since the open, Close invalidates the path
+    HandlePool* handlePool;
+    std::string poolKey; //< empty unless the handle goes back to the pool
+    ProxyEndpoint* endpoint;
+    Stats* stats;
+    std::map<std::string, std::string> properties; //< set by the user, kept for new handles
+
+    //------------------------------------------------------------------------
+    // Switch to another handle, it gets the properties the user has set
+    //------------------------------------------------------------------------
+    void setFile(std::unique_ptr<XrdCl::File> f) {
+        xfile = std::move(f);
+        source.SetFile(xfile.get());
+        writeBehind.SetFile(xfile.get());
+        for (auto& p : properties)
+            xfile->SetProperty(p.first, p.second);
+    }
+
+    //------------------------------------------------------------------------
+    // The URL behind the proxy prefix, the URL itself if it has none
+    //------------------------------------------------------------------------
+    static std::string removePrefix(const std::string& url) {
+        size_t pos = url.find("://");
+        pos = pos == std::string::npos ? pos : url.find("://", pos + 3);
+        if (pos == std::string::npos)
+            return url;
+        while (pos > 0 && isalnum(static_cast<unsigned char>(url[pos - 1])))
+            --pos;
+        return url.substr(pos);
+    }
+
+    //------------------------------------------------------------------------
+    // Send the buffered writes before an operation that has to see them,
+    // blocks until they are acknowledged. Their errors are left for the
+    // next Write, Sync or Close.
+    //------------------------------------------------------------------------
+    void flushWrites() {
+        if (WriteBehind::enabled())
+            writeBehind.Flush();
+    }
+
+    //------------------------------------------------------------------------
+    // Flush and send a Sync or Close with a handler that gets the error of
+    // a buffered write
+    //------------------------------------------------------------------------
+    template <typename Send>
+    XRootDStatus reportWrites(ResponseHandler* handler, Send send) {
+        flushWrites();
+        ResponseHandler* report = handler ? writeBehind.Report(handler) : handler;
+        XRootDStatus st = send(report);
+        if (!st.IsOK() && report != handler)
+            delete report;
+        return st;
+    }
+
+    //------------------------------------------------------------------------
+    // Time the operation against the endpoint of the file
+    //------------------------------------------------------------------------
+    size_t statsEndpoint() const { return stats ? stats->Endpoint(endpoint) : 0; }
+
+    static bool readOnly(OpenFlags::Flags flags) {
+        return !(flags & (OpenFlags::Update | OpenFlags::Write | OpenFlags::Append |
+                          OpenFlags::Delete | OpenFlags::New));
+    }
+
+    //------------------------------------------------------------------------
+    // Reopens the file through another healthy proxy when the open did not
+    // get an answer from the proxy it was sent to
+    //------------------------------------------------------------------------
+    class OpenRetryHandler : public XrdCl::ResponseHandler {
+      private:
+        ProxyPrefixFile* file;
+        std::string url;
+        std::string key;
+        OpenFlags::Flags flags;
+        Access::Mode mode;
+        ResponseHandler* handler;
+        uint16_t timeout;
+        uint32_t retries;
+
+      public:
+        OpenRetryHandler(ProxyPrefixFile* f, const std::string& u, const std::string& k,
+                         OpenFlags::Flags fl, Access::Mode m, ResponseHandler* h, uint16_t t,
+                         uint32_t r)
+          : file(f), url(u), key(k), flags(fl), mode(m), handler(h), timeout(t), retries(r) {}
+
+        virtual void HandleResponseWithHosts(XRootDStatus* status, AnyObject* response,
+                                             HostList* hostList) {
+            if (!status->IsOK() && status->code != errErrorResponse && retries) {
+                ProxyEndpoint* failed = file->endpoint;
+                failed->ReportHealth(false);
+                ProxyEndpoint* next = file->proxies->Select(key, failed);
+                if (next != failed) {
+                    XrdCl::Log* log = XrdCl::DefaultEnv::GetLog();
+                    log->Info(1, "XrdProxyPrefix: open through %s failed (%s), trying %s",
+                              failed->GetHost().c_str(), status->ToString().c_str(),
+                              next->GetHost().c_str());
+                    --retries;
+                    // a file object that failed to open cannot be opened again
+                    file->endpoint = next;
+                    file->setFile(std::unique_ptr<XrdCl::File>(new XrdCl::File(false)));
+                    XRootDStatus st = file->SendOpen(url, flags, mode, this, timeout);
+                    if (st.IsOK()) {
+                        delete status;
+                        delete response;
+                        delete hostList;
+                        return;
+                    }
+                    *status = st;
+                }
+            }
+            handler->HandleResponseWithHosts(status, response, hostList);
+            delete this;
+        }
+    };
+
+    XRootDStatus SendOpen(const std::string& url, OpenFlags::Flags flags, Access::Mode mode,
+                          ResponseHandler* handler, uint16_t timeout) {
+        source.SetLocation(location, readOnly(flags), proxies->Size() > 1 ? endpoint : 0);
+        if (!endpoint)
+            return xfile->Open(url, flags, mode, handler, timeout);
+        if (!handler || proxies->Size() == 1)
+            return xfile->Open(AddPrefix(url), flags, mode, handler, timeout);
+        TrackedHandler* tracked = endpoint->Track(handler);
+        XRootDStatus st = xfile->Open(AddPrefix(url), flags, mode, tracked, timeout);
+        if (!st.IsOK())
+            tracked->Cancel();
+        return st;
+    }
+
+  public:
+    static void setVectorReadLimits(uint32_t gap, uint32_t maxChunks, uint32_t maxChunkSize) {
+        vectorReadGap = gap;
+        vectorReadMaxChunks = std::max<uint32_t>(maxChunks, 1);
+        vectorReadMaxChunkSize = std::max<uint32_t>(maxChunkSize, 1);
+    }
+    static void setOpenRetries(uint32_t retries) { openRetries = retries; }
+    std::string AddPrefix(const std::string& url) {
         XrdCl::Log* log = XrdCl::DefaultEnv::GetLog();
-        XrdCl::URL xUrl(url);
-        std::string ppc = proxyPrefix;
-        std::string newurl = std::string(xUrl.GetProtocol()).append(std::string(ppc)).append(url);
-        std::stringstream out;
-        out << "XrdProxyPrefix::setting  url:\"" << url << " to: " << newurl << "\"" << std::endl;
-        log->Debug(1, out.str().c_str());
+        const std::string& ppc = endpoint->GetPrefix();
+        size_t length;
+        const char* protocol = urlProtocol(url, length);
+        std::string newurl;
+        newurl.reserve(length + ppc.size() + url.size());
+        newurl.append(protocol, length).append(ppc).append(url);
+        log->Debug(1, "XrdProxyPrefix::setting url: \"%s\" to: \"%s\"", url.c_str(),
+                   newurl.c_str());
         return newurl;
     }
 
-    ProxyPrefixFile() : xfile(false) {
+    ProxyPrefixFile(BlockCache* cache, DiskCache* diskCache, ProxyList* proxyList,
+                    BypassRules* bypassRules, MetadataCache* metadata, NegativeCache* misses,
+                    HandlePool* pool, Stats* opStats)
+      : xfile(new XrdCl::File(false)), writeBehind(xfile.get()), source(xfile.get(), diskCache),
+        readAhead(source), blockCache(cache), proxies(proxyList), bypass(bypassRules),
+        metaCache(metadata), negCache(misses), modified(false), handlePool(pool), endpoint(0),
+        stats(opStats) {
         XrdCl::Log* log = XrdCl::DefaultEnv::GetLog();
         log->Debug(1, "ProxyPrefixFile::ProxyPrefixFile");
     }
@@ -55,76 +406,299 @@ class ProxyPrefixFile : public XrdCl::FilePlugIn {
     virtual XRootDStatus Open(const std::string& url, OpenFlags::Flags flags, Access::Mode mode,
                               ResponseHandler* handler, uint16_t timeout) {
         XrdCl::Log* log = XrdCl::DefaultEnv::GetLog();
-        XRootDStatus* ret_st;
-        auto newurl = AddPrefix(url);
+        XrdCl::URL xURL(url);
+        location = xURL.GetLocation();
+        TimedRequest timed(stats, 0, Stats::Open, handler);
+        handler = timed.Handler();
+        if (handlePool && handler && readOnly(flags)) {
+            poolKey = HandlePool::Key(url, flags);
+            ProxyEndpoint* pooledEndpoint;
+            std::unique_ptr<XrdCl::File> pooled = handlePool->Take(poolKey, pooledEndpoint);
+            if (pooled) {
+                log->Debug(1, "XrdProxyPrefix: reusing the open handle of %s", url.c_str());
+                setFile(std::move(pooled));
+                // the handle still goes through the proxy it was opened with
+                endpoint = pooledEndpoint;
+                source.SetLocation(location, true, proxies->Size() > 1 ? endpoint : 0);
+                timed.SetEndpoint(statsEndpoint());
+                handler->HandleResponseWithHosts(new XRootDStatus(), 0, new HostList());
+                return timed.Sent(XRootDStatus());
+            }
+        }
+        // opens that may create the file bypass the negative cache and
+        // invalidate what the metadata cache knows about the path
+        metaKey = NegativeCache::Key(xURL.GetHostId(), xURL.GetPath());
+        modified = false;
+        NegativeCache* misses = 0;
+        if (negCache && handler) {
+            if (readOnly(flags))
+                misses = negCache;
+            else
+                negCache->Remove(metaKey);
+        }
+        NegativeLookup lookup(misses, metaKey, handler);
+        if (lookup.Answered())
+            return timed.Sent(XRootDStatus());
+        handler = lookup.Handler();
+        MetadataRequest meta(readOnly(flags) ? 0 : metaCache,
+                             std::vector<std::string>(1, metaKey), handler);
+        handler = meta.Handler();
+        if (bypass->Match(xURL)) {
+            log->Debug(1, "XrdProxyPrefix: opening %s directly", url.c_str());
+            endpoint = 0;
+            return timed.Sent(lookup.Sent(meta.Sent(SendOpen(url, flags, mode, handler, timeout))));
+        }
+        std::string key;
+        key.reserve(xURL.GetHostName().size() + 1 + xURL.GetPath().size());
+        key.append(xURL.GetHostName()).append(1, '/').append(xURL.GetPath());
+        endpoint = proxies->Select(key);
+        timed.SetEndpoint(statsEndpoint());
         log->Debug(1, "ProxyPrefixFile::Open");
-        return xfile.Open(AddPrefix(url), flags, mode, handler, timeout);
+        OpenRetryHandler* retry = 0;
+        if (handler && openRetries && proxies->Size() > 1)
+            handler = retry =
+              new OpenRetryHandler(this, url, key, flags, mode, handler, timeout, openRetries);
+        XRootDStatus st = SendOpen(url, flags, mode, handler, timeout);
+        if (!st.IsOK())
+            delete retry;
+        return timed.Sent(lookup.Sent(meta.Sent(st)));
     }
     virtual XRootDStatus Close(ResponseHandler* handler, uint16_t timeout) {
-        return xfile.Close(handler, timeout);
+        readAhead.Reset();
+        fetches.Drain();
+        TimedRequest timed(stats, statsEndpoint(), Stats::Close, handler);
+        handler = timed.Handler();
+        if (!poolKey.empty() && handler && xfile->IsOpen()) {
+            handlePool->Put(poolKey, std::move(xfile), endpoint);
+            setFile(std::unique_ptr<XrdCl::File>(new XrdCl::File(false)));
+            poolKey.clear();
+            handler->HandleResponseWithHosts(new XRootDStatus(), 0, new HostList());
+            return timed.Sent(XRootDStatus());
+        }
+        // the file is closed even if one of the buffered writes failed, the
+        // size and mtime cached for the path are stale once it completes
+        MetadataRequest meta(modified ? metaCache : 0, std::vector<std::string>(1, metaKey),
+                             handler);
+        modified = false;
+        return timed.Sent(meta.Sent(reportWrites(meta.Handler(), [&](ResponseHandler* h) {
+            return xfile->Close(h, timeout);
+        })));
+    }
+    virtual XRootDStatus Sync(ResponseHandler* handler, uint16_t timeout) {
+        TimedRequest timed(stats, statsEndpoint(), Stats::Sync, handler);
+        return timed.Sent(reportWrites(timed.Handler(), [&](ResponseHandler* h) {
+            return xfile->Sync(h, timeout);
+        }));
+    }
+    virtual XRootDStatus Fcntl(const Buffer& arg, ResponseHandler* handler, uint16_t timeout) {
+        TimedRequest timed(stats, statsEndpoint(), Stats::Fcntl, handler);
+        flushWrites();
+        return timed.Sent(xfile->Fcntl(arg, timed.Handler(), timeout));
+    }
+    virtual XRootDStatus Visa(ResponseHandler* handler, uint16_t timeout) {
+        TimedRequest timed(stats, statsEndpoint(), Stats::Visa, handler);
+        return timed.Sent(xfile->Visa(timed.Handler(), timeout));
+    }
+    virtual bool IsOpen() const { return xfile->IsOpen(); }
+    virtual bool SetProperty(const std::string& name, const std::string& value) {
+        if (!xfile->SetProperty(name, value))
+            return false;
+        properties[name] = value;
+        return true;
+    }
+
+    //------------------------------------------------------------------------
+    // DataServer and LastURL name the server behind the proxy: callers use
+    // them to reach the file with their own file system, which goes through
+    // the proxy again
+    //------------------------------------------------------------------------
+    virtual bool GetProperty(const std::string& name, std::string& value) const {
+        if (!xfile->GetProperty(name, value))
+            return false;
+        if (name != "DataServer" && name != "LastURL")
+            return true;
+        std::string lastUrl;
+        if (!xfile->GetProperty("LastURL", lastUrl))
+            return true;
+        std::string url = removePrefix(lastUrl);
+        value = name == "LastURL" ? url : XrdCl::URL(url).GetHostId();
+        return true;
     }
-    virtual bool IsOpen() const { return xfile.IsOpen(); }
     virtual XRootDStatus Stat(bool force, ResponseHandler* handler, uint16_t timeout) {
-        return xfile.Stat(force, handler, timeout);
+        TimedRequest timed(stats, statsEndpoint(), Stats::Stat, handler);
+        if (force)
+            flushWrites();
+        return timed.Sent(xfile->Stat(force, timed.Handler(), timeout));
     }
 
     virtual XRootDStatus Read(uint64_t offset, uint32_t length, void* buffer,
                               XrdCl::ResponseHandler* handler, uint16_t timeout) {
         XrdCl::Log* log = XrdCl::DefaultEnv::GetLog();
         log->Debug(1, "ProxyPrefixFile::Read");
-        assert(xfile.IsOpen() == true);
-        return xfile.Read(offset, length, buffer, handler, timeout);
+        assert(xfile->IsOpen() == true);
+        TimedRequest timed(stats, statsEndpoint(), Stats::Read, handler);
+        handler = timed.Handler();
+        flushWrites();
+        if (blockCache)
+            return timed.Sent(blockCache->Read(location, source, fetches, offset, length, buffer,
+                                               handler, timeout));
+        if (readAhead.Read(offset, length, buffer, handler, timeout))
+            return timed.Sent(XRootDStatus());
+        return timed.Sent(source.Read(offset, length, buffer, handler, timeout));
     }
 
     XRootDStatus Write(uint64_t offset, uint32_t size, const void* buffer, ResponseHandler* handler,
                        uint16_t timeout = 0) {
         XrdCl::Log* log = XrdCl::DefaultEnv::GetLog();
         log->Debug(1, "ProxyPrefixFile::Write");
-        assert(xfile.IsOpen() == true);
-        return xfile.Write(offset, size, buffer, handler, timeout);
+        assert(xfile->IsOpen() == true);
+        readAhead.Reset();
+        if (blockCache)
+            blockCache->Invalidate(location);
+        TimedRequest timed(stats, statsEndpoint(), Stats::Write, handler, size);
+        modified = true;
+        if (WriteBehind::enabled())
+            return timed.Sent(writeBehind.Write(offset, size, buffer, timed.Handler(), timeout));
+        return timed.Sent(xfile->Write(offset, size, buffer, timed.Handler(), timeout));
+    }
+
+    virtual XRootDStatus Truncate(uint64_t size, ResponseHandler* handler, uint16_t timeout) {
+        XrdCl::Log* log = XrdCl::DefaultEnv::GetLog();
+        log->Debug(1, "ProxyPrefixFile::Truncate");
+        TimedRequest timed(stats, statsEndpoint(), Stats::Truncate, handler);
+        flushWrites();
+        readAhead.Reset();
+        if (blockCache)
+            blockCache->Invalidate(location);
+        MetadataRequest meta(metaCache, std::vector<std::string>(1, metaKey), timed.Handler());
+        return timed.Sent(meta.Sent(xfile->Truncate(size, meta.Handler(), timeout)));
+    }
+
+    virtual XRootDStatus VectorRead(const ChunkList& chunks, void* buffer,
+                                    ResponseHandler* handler, uint16_t timeout) {
+        XrdCl::Log* log = XrdCl::DefaultEnv::GetLog();
+        log->Debug(1, "ProxyPrefixFile::VectorRead");
+        assert(xfile->IsOpen() == true);
+        TimedRequest timed(stats, statsEndpoint(), Stats::VectorRead, handler);
+        handler = timed.Handler();
+        flushWrites();
+        ChunkList userChunks(chunks);
+        if (char* cursor = static_cast<char*>(buffer)) {
+            for (auto& c : userChunks) {
+                c.buffer = cursor;
+                cursor += c.length;
+            }
+        }
+        VectorReadCollector* collector = new VectorReadCollector(userChunks, handler);
+        std::vector<ChunkList> requests =
+          collector->Plan(vectorReadGap, vectorReadMaxChunks, vectorReadMaxChunkSize);
+        if (requests.size() == 1 && requests[0].size() == chunks.size() &&
+            !collector->Coalesced()) {
+            delete collector;
+            return timed.Sent(xfile->VectorRead(chunks, buffer, handler, timeout));
+        }
+        return timed.Sent(collector->Send(*xfile, requests, timeout));
     }
 };
-std::string ProxyPrefixFile::proxyPrefix = "UNSET";
+uint32_t ProxyPrefixFile::vectorReadGap = 4096;
+uint32_t ProxyPrefixFile::vectorReadMaxChunks = 1024;
+uint32_t ProxyPrefixFile::vectorReadMaxChunkSize = 2097136;
+uint32_t ProxyPrefixFile::openRetries = 0;
 
 class ProxyPrefixFs : public XrdCl::FileSystemPlugIn {
   private:
-    static string proxyPrefix;
-    static XrdCl::URL targetURL;
-    static int level;
+    ProxyList* proxies;
+    BypassRules* bypass;
+    XrdCl::URL targetURL;
+    // 0 for a target, > 0 for a URL that already goes through a proxy
     int mylevel;
+    bool direct;
+    std::string targetPrefix;
+    std::unique_ptr<XrdCl::FileSystem> directFs;
+    MetadataCache* metaCache;
+    NegativeCache* negCache;
+    StatBatch statBatch;
+    ProxyEndpoint* endpoint; //< 0 unless the file system goes through a proxy
+    Stats* stats;
+
+    //------------------------------------------------------------------------
+    // Time the operation against the proxy the path goes through, index 0
+    // is the direct access
+    //------------------------------------------------------------------------
+    size_t statsEndpoint(const std::string& path = std::string()) const {
+        if (!stats || !endpoint || (directFs && !path.empty() && bypass->MatchPath(path)))
+            return 0;
+        return stats->Endpoint(endpoint);
+    }
+
+    //------------------------------------------------------------------------
+    // Key of the path in the metadata and negative caches
+    //------------------------------------------------------------------------
+    std::string cacheKey(const std::string& path) const {
+        return NegativeCache::Key(targetURL.GetHostId(), path);
+    }
+
+    //------------------------------------------------------------------------
+    // How many proxies the URL already passes: one if it points at one of
+    // ours, plus one per URL nested in its path
+    //------------------------------------------------------------------------
+    int nestingLevel(const XrdCl::URL& xURL) const {
+        int level = proxies->Contains(xURL.GetHostId()) ? 1 : 0;
+        const std::string& path = xURL.GetPath();
+        for (size_t pos = path.find("://"); pos != std::string::npos;
+             pos = path.find("://", pos + 3))
+            ++level;
+        return level;
+    }
 
   public:
     XrdCl::FileSystem xfs;
 
-    std::string getProxyDecor(std::string path) {
+    std::string getProxyDecor(const XrdCl::URL& xURL) {
         XrdCl::Log* log = XrdCl::DefaultEnv::GetLog();
         log->Debug(1, "ProxyPrefixFs::ProxyDecor");
-        XrdCl::URL xURL(path);
-        char buffer[2048];
-        snprintf(buffer, 2048, "%s://%s", xURL.GetProtocol().c_str(), proxyPrefix.c_str());
-        return buffer;
+        std::string key;
+        key.reserve(xURL.GetHostName().size() + 1 + xURL.GetPath().size());
+        key.append(xURL.GetHostName()).append(1, '/').append(xURL.GetPath());
+        endpoint = proxies->Select(key);
+        const std::string& prefix = endpoint->GetPrefix();
+        std::string decor;
+        decor.reserve(xURL.GetProtocol().size() + prefix.size());
+        decor.append(xURL.GetProtocol()).append(prefix);
+        return decor;
     }
 
-    std::string prepURL(std::string path) {
-        XrdCl::Log* log = XrdCl::DefaultEnv::GetLog();
-        XrdCl::URL xURL(path);
-        char buffer[2048];
-        snprintf(buffer, 2048, "/%s://%s/", targetURL.GetProtocol().c_str(),
-                 targetURL.GetHostId().c_str());
-        return buffer;
+    //------------------------------------------------------------------------
+    // The path as seen through the proxy: the target URL followed by the
+    // path, e.g. /root://target:1094//data/file
+    //------------------------------------------------------------------------
+    std::string prepURL(const std::string& path) {
+        std::string url;
+        url.reserve(targetPrefix.size() + path.size());
+        url.append(targetPrefix).append(path);
+        return url;
     }
 
-    static void setProxyPrefix(std::string toProxyPrefix) { proxyPrefix = toProxyPrefix; }
-
-    ProxyPrefixFs(std::string url) : xfs((level == 0) ? getProxyDecor(url) : url, false) {
+    //------------------------------------------------------------------------
+    // All state is bound to the instance, file systems may be created and
+    // used from any number of threads
+    //------------------------------------------------------------------------
+    ProxyPrefixFs(const std::string& url, ProxyList* proxyList, BypassRules* bypassRules,
+                  MetadataCache* cache, NegativeCache* misses, Stats* opStats)
+      : proxies(proxyList), bypass(bypassRules), targetURL(url), mylevel(nestingLevel(targetURL)),
+        direct(bypass->Match(targetURL)), metaCache(cache), negCache(misses),
+        statBatch(*this), endpoint(0), stats(opStats),
+        xfs((mylevel == 0 && !direct) ? getProxyDecor(targetURL) : url, false) {
         XrdCl::Log* log = XrdCl::DefaultEnv::GetLog();
         log->Debug(1, "ProxyPrefixFs::ProxyPrefixFs");
-        if (level == 0) {
-            log->Debug(1, "Setting targetURL");
-            targetURL = XrdCl::URL(url);
+        if (direct || mylevel != 0) {
+            log->Debug(1, "XrdProxyPrefix: accessing %s directly", url.c_str());
+            return;
         }
-        mylevel = level;
-        level++;
+        targetPrefix = "/" + targetURL.GetProtocol() + "://" + targetURL.GetHostId() + "/";
+        // paths matching a bypass rule go to the target itself
+        if (bypass->HasPathRules())
+            directFs.reset(new XrdCl::FileSystem(targetURL, false));
     }
 
     ~ProxyPrefixFs() {}
@@ -133,113 +707,230 @@ class ProxyPrefixFs : public XrdCl::FileSystemPlugIn {
                                 ResponseHandler* handler, uint16_t timeout) {
         XrdCl::Log* log = XrdCl::DefaultEnv::GetLog();
         log->Debug(1, "ProxyPrefixFs::Locate");
-        if (mylevel == 0)
-            return xfs.Locate(prepURL(path), flags, handler, timeout);
-        return xfs.Locate(path, flags, handler, timeout);
+        TimedRequest timed(stats, statsEndpoint(path), Stats::Locate, handler);
+        handler = timed.Handler();
+        // only plain lookups are cached, the flags may ask for a refresh
+        MetadataRequest req(flags == OpenFlags::None ? metaCache : 0, MetadataCache::Locate,
+                            cacheKey(path), handler);
+        if (req.Answered())
+            return timed.Sent(XRootDStatus());
+        if (directFs && bypass->MatchPath(path))
+            return timed.Sent(req.Sent(directFs->Locate(path, flags, req.Handler(), timeout)));
+        if (mylevel == 0 && !direct)
+            return timed.Sent(req.Sent(xfs.Locate(prepURL(path), flags, req.Handler(), timeout)));
+        return timed.Sent(req.Sent(xfs.Locate(path, flags, req.Handler(), timeout)));
     }
     virtual XRootDStatus Truncate(const std::string& path, uint64_t size, ResponseHandler* handler,
                                   uint16_t timeout) {
         XrdCl::Log* log = XrdCl::DefaultEnv::GetLog();
         log->Debug(1, "ProxyPrefixFs::Truncate");
-        if (mylevel == 0)
-            return xfs.Truncate(prepURL(path), size, handler, timeout);
-        return xfs.Truncate(path, size, handler, timeout);
+        TimedRequest timed(stats, statsEndpoint(path), Stats::FsTruncate, handler);
+        handler = timed.Handler();
+        MetadataRequest req(metaCache, std::vector<std::string>(1, cacheKey(path)), handler);
+        if (directFs && bypass->MatchPath(path))
+            return timed.Sent(req.Sent(directFs->Truncate(path, size, req.Handler(), timeout)));
+        if (mylevel == 0 && !direct)
+            return timed.Sent(req.Sent(xfs.Truncate(prepURL(path), size, req.Handler(), timeout)));
+        return timed.Sent(req.Sent(xfs.Truncate(path, size, req.Handler(), timeout)));
     }
     virtual XRootDStatus Rm(const std::string& path, ResponseHandler* handler, uint16_t timeout) {
         XrdCl::Log* log = XrdCl::DefaultEnv::GetLog();
         log->Debug(1, "ProxyPrefixFs::Rm");
-        if (mylevel == 0)
-            return xfs.Rm(prepURL(path), handler, timeout);
-        return xfs.Rm(path, handler, timeout);
+        TimedRequest timed(stats, statsEndpoint(path), Stats::Rm, handler);
+        handler = timed.Handler();
+        MetadataRequest req(metaCache, std::vector<std::string>(1, cacheKey(path)), handler);
+        if (directFs && bypass->MatchPath(path))
+            return timed.Sent(req.Sent(directFs->Rm(path, req.Handler(), timeout)));
+        if (mylevel == 0 && !direct)
+            return timed.Sent(req.Sent(xfs.Rm(prepURL(path), req.Handler(), timeout)));
+        return timed.Sent(req.Sent(xfs.Rm(path, req.Handler(), timeout)));
     }
     virtual XRootDStatus MkDir(const std::string& path, MkDirFlags::Flags flags, Access::Mode mode,
                                ResponseHandler* handler, uint16_t timeout) {
         XrdCl::Log* log = XrdCl::DefaultEnv::GetLog();
         log->Debug(1, "ProxyPrefixFs::MkDir");
-        if (mylevel == 0)
-            return xfs.MkDir(prepURL(path), flags, mode, handler, timeout);
-        return xfs.MkDir(path, flags, mode, handler, timeout);
+        TimedRequest timed(stats, statsEndpoint(path), Stats::MkDir, handler);
+        handler = timed.Handler();
+        if (negCache)
+            negCache->Remove(cacheKey(path));
+        MetadataRequest req(metaCache, std::vector<std::string>(1, cacheKey(path)), handler);
+        if (directFs && bypass->MatchPath(path))
+            return timed.Sent(
+              req.Sent(directFs->MkDir(path, flags, mode, req.Handler(), timeout)));
+        if (mylevel == 0 && !direct)
+            return timed.Sent(
+              req.Sent(xfs.MkDir(prepURL(path), flags, mode, req.Handler(), timeout)));
+        return timed.Sent(req.Sent(xfs.MkDir(path, flags, mode, req.Handler(), timeout)));
     }
     virtual XRootDStatus RmDir(const std::string& path, ResponseHandler* handler,
                                uint16_t timeout) {
         XrdCl::Log* log = XrdCl::DefaultEnv::GetLog();
         log->Debug(1, "ProxyPrefixFs::RmDir");
-        if (mylevel == 0)
-            return xfs.RmDir(prepURL(path), handler, timeout);
-        return xfs.RmDir(path, handler, timeout);
+        TimedRequest timed(stats, statsEndpoint(path), Stats::RmDir, handler);
+        handler = timed.Handler();
+        MetadataRequest req(metaCache, std::vector<std::string>(1, cacheKey(path)), handler);
+        if (directFs && bypass->MatchPath(path))
+            return timed.Sent(req.Sent(directFs->RmDir(path, req.Handler(), timeout)));
+        if (mylevel == 0 && !direct)
+            return timed.Sent(req.Sent(xfs.RmDir(prepURL(path), req.Handler(), timeout)));
+        return timed.Sent(req.Sent(xfs.RmDir(path, req.Handler(), timeout)));
     }
     virtual XRootDStatus ChMod(const std::string& path, Access::Mode mode, ResponseHandler* handler,
                                uint16_t timeout) {
         XrdCl::Log* log = XrdCl::DefaultEnv::GetLog();
         log->Debug(1, "ProxyPrefixFs::ChMod");
-        if (mylevel == 0)
-            return xfs.ChMod(prepURL(path), mode, handler, timeout);
-        return xfs.ChMod(path, mode, handler, timeout);
+        TimedRequest timed(stats, statsEndpoint(path), Stats::ChMod, handler);
+        handler = timed.Handler();
+        MetadataRequest req(metaCache, std::vector<std::string>(1, cacheKey(path)), handler);
+        if (directFs && bypass->MatchPath(path))
+            return timed.Sent(req.Sent(directFs->ChMod(path, mode, req.Handler(), timeout)));
+        if (mylevel == 0 && !direct)
+            return timed.Sent(req.Sent(xfs.ChMod(prepURL(path), mode, req.Handler(), timeout)));
+        return timed.Sent(req.Sent(xfs.ChMod(path, mode, req.Handler(), timeout)));
+    }
+    virtual XRootDStatus Mv(const std::string& source, const std::string& dest,
+                            ResponseHandler* handler, uint16_t timeout) {
+        XrdCl::Log* log = XrdCl::DefaultEnv::GetLog();
+        log->Debug(1, "ProxyPrefixFs::Mv");
+        TimedRequest timed(stats, statsEndpoint(source), Stats::Mv, handler);
+        handler = timed.Handler();
+        std::vector<std::string> keys;
+        keys.push_back(cacheKey(source));
+        keys.push_back(cacheKey(dest));
+        if (negCache)
+            negCache->Remove(keys.back());
+        MetadataRequest req(metaCache, keys, handler);
+        if (directFs && bypass->MatchPath(source) && bypass->MatchPath(dest))
+            return timed.Sent(req.Sent(directFs->Mv(source, dest, req.Handler(), timeout)));
+        if (mylevel == 0 && !direct)
+            return timed.Sent(
+              req.Sent(xfs.Mv(prepURL(source), prepURL(dest), req.Handler(), timeout)));
+        return timed.Sent(req.Sent(xfs.Mv(source, dest, req.Handler(), timeout)));
     }
 
     virtual XRootDStatus Ping(ResponseHandler* handler, uint16_t timeout) {
         XrdCl::Log* log = XrdCl::DefaultEnv::GetLog();
         log->Debug(1, "ProxyPrefixFs::Ping");
-        return xfs.Ping(handler, timeout);
+        TimedRequest timed(stats, statsEndpoint(), Stats::Ping, handler);
+        handler = timed.Handler();
+        return timed.Sent(xfs.Ping(handler, timeout));
     }
     virtual XRootDStatus Query(QueryCode::Code queryCode, const Buffer& arg,
                                ResponseHandler* handler, uint16_t timeout) {
 
         XrdCl::Log* log = XrdCl::DefaultEnv::GetLog();
         log->Debug(1, "ProxyPrefixFs::Query");
-        return xfs.Query(queryCode, arg, handler, timeout);
+        TimedRequest timed(stats, statsEndpoint(), Stats::Query, handler);
+        handler = timed.Handler();
+        return timed.Sent(xfs.Query(queryCode, arg, handler, timeout));
     }
     virtual XRootDStatus DirList(const std::string& path, DirListFlags::Flags flags,
                                  ResponseHandler* handler, uint16_t timeout) {
         XrdCl::Log* log = DefaultEnv::GetLog();
         log->Debug(1, "ProxyPrefixFs::Dirlist");
-        if (mylevel == 0)
-            return xfs.DirList(prepURL(path), flags, handler, timeout);
-        return xfs.DirList(prepURL(path), flags, handler, timeout);
+        TimedRequest timed(stats, statsEndpoint(path), Stats::DirList, handler);
+        handler = timed.Handler();
+        if (directFs && bypass->MatchPath(path))
+            return timed.Sent(directFs->DirList(path, flags, handler, timeout));
+        if (mylevel == 0 && !direct)
+            return timed.Sent(xfs.DirList(prepURL(path), flags, handler, timeout));
+        return timed.Sent(xfs.DirList(path, flags, handler, timeout));
     }
 
     virtual XRootDStatus Stat(const std::string& path, ResponseHandler* handler, uint16_t timeout) {
         XrdCl::Log* log = DefaultEnv::GetLog();
         log->Debug(1, "ProxyPrefixFs::Stat");
-        if (mylevel == 0)
-            return xfs.Stat(prepURL(path), handler, timeout);
-        return xfs.Stat(path, handler, timeout);
+        TimedRequest timed(stats, statsEndpoint(path), Stats::FsStat, handler);
+        handler = timed.Handler();
+        std::string key = cacheKey(path);
+        NegativeLookup lookup(negCache, key, handler);
+        if (lookup.Answered())
+            return timed.Sent(XRootDStatus());
+        MetadataRequest req(metaCache, MetadataCache::Stat, key, lookup.Handler());
+        if (req.Answered())
+            return timed.Sent(lookup.Sent(XRootDStatus()));
+        if (directFs && bypass->MatchPath(path))
+            return timed.Sent(
+              lookup.Sent(req.Sent(directFs->Stat(path, req.Handler(), timeout))));
+        if (mylevel == 0 && !direct)
+            return timed.Sent(
+              lookup.Sent(req.Sent(xfs.Stat(prepURL(path), req.Handler(), timeout))));
+        return timed.Sent(lookup.Sent(req.Sent(xfs.Stat(path, req.Handler(), timeout))));
     }
     virtual XRootDStatus StatVFS(const std::string& path, ResponseHandler* handler,
                                  uint16_t timeout) {
         XrdCl::Log* log = XrdCl::DefaultEnv::GetLog();
         log->Debug(1, "ProxyPrefixFs::StatVFS");
-        if (mylevel == 0)
-            return xfs.StatVFS(prepURL(path), handler, timeout);
-        return xfs.StatVFS(path, handler, timeout);
+        TimedRequest timed(stats, statsEndpoint(path), Stats::StatVFS, handler);
+        handler = timed.Handler();
+        MetadataRequest req(metaCache, MetadataCache::StatVFS, cacheKey(path), handler);
+        if (req.Answered())
+            return timed.Sent(XRootDStatus());
+        if (directFs && bypass->MatchPath(path))
+            return timed.Sent(req.Sent(directFs->StatVFS(path, req.Handler(), timeout)));
+        if (mylevel == 0 && !direct)
+            return timed.Sent(req.Sent(xfs.StatVFS(prepURL(path), req.Handler(), timeout)));
+        return timed.Sent(req.Sent(xfs.StatVFS(path, req.Handler(), timeout)));
     }
     virtual XRootDStatus Protocol(ResponseHandler* handler, uint16_t timeout) {
         XrdCl::Log* log = XrdCl::DefaultEnv::GetLog();
         log->Debug(1, "ProxyPrefixFs::Protocol");
-        return xfs.Protocol(handler, timeout);
+        TimedRequest timed(stats, statsEndpoint(), Stats::Protocol, handler);
+        handler = timed.Handler();
+        return timed.Sent(xfs.Protocol(handler, timeout));
     }
     virtual XRootDStatus SendInfo(const std::string& info, ResponseHandler* handler,
                                   uint16_t timeout) {
         XrdCl::Log* log = XrdCl::DefaultEnv::GetLog();
         log->Debug(1, "ProxyPrefixFs::Protocol");
-        return xfs.SendInfo(info, handler, timeout);
+        TimedRequest timed(stats, statsEndpoint(), Stats::SendInfo, handler);
+        handler = timed.Handler();
+        return timed.Sent(xfs.SendInfo(info, handler, timeout));
     }
     virtual XRootDStatus Prepare(const std::vector<std::string>& fileList,
                                  PrepareFlags::Flags flags, uint8_t priority,
                                  ResponseHandler* handler, uint16_t timeout) {
-        if (mylevel == 0) {
+        TimedRequest timed(stats, statsEndpoint(), Stats::Prepare, handler);
+        handler = timed.Handler();
+        if (directFs && std::all_of(fileList.begin(), fileList.end(),
+                                    [this](const std::string& path) {
+                                        return bypass->MatchPath(path);
+                                    }))
+            return timed.Sent(directFs->Prepare(fileList, flags, priority, handler, timeout));
+        if (mylevel == 0 && !direct) {
             std::vector<std::string> newList;
             for (auto it : fileList)
                 newList.push_back(prepURL(it));
-            return xfs.Prepare(newList, flags, priority, handler, timeout);
+            return timed.Sent(xfs.Prepare(newList, flags, priority, handler, timeout));
         }
-        return xfs.Prepare(fileList, flags, priority, handler, timeout);
+        return timed.Sent(xfs.Prepare(fileList, flags, priority, handler, timeout));
+    }
+
+    //------------------------------------------------------------------------
+    // The StatBatch properties and the ProxyPrefixStats dump are handled
+    // here, the others by the file system
+    //------------------------------------------------------------------------
+    virtual bool SetProperty(const std::string& name, const std::string& value) {
+        if (statBatch.SetProperty(name, value))
+            return true;
+        return xfs.SetProperty(name, value);
+    }
+
+    virtual bool GetProperty(const std::string& name, std::string& value) const {
+        if (name == "StatBatch") {
+            statBatch.Run(value);
+            return true;
+        }
+        if (name == "ProxyPrefixStats") {
+            if (!stats)
+                return false;
+            value = stats->Dump();
+            return true;
+        }
+        return xfs.GetProperty(name, value);
     }
 };
 
-int ProxyPrefixFs::level = 0;
-std::string ProxyPrefixFs::proxyPrefix = "UNSET";
-XrdCl::URL ProxyPrefixFs::targetURL;
 } // namespace ProxyPrefix
 namespace PPFactory {
 
@@ -285,44 +976,130 @@ void ProxyPrefixFactory::loadDefaultConf(std::map<std::string, std::string>& con
     }
 }
 
+uint64_t ProxyPrefixFactory::getConfigNumber(const std::map<std::string, std::string>& config,
+                                             const std::string& key, uint64_t defaultValue) {
+    auto it = config.find(key);
+    if (it == config.end())
+        return defaultValue;
+    char* end = 0;
+    uint64_t value = std::strtoull(it->second.c_str(), &end, 10);
+    if (end == it->second.c_str() || *end != 0) {
+        XrdCl::Log* log = DefaultEnv::GetLog();
+        log->Error(1, "XrdProxyPrefix: ignoring invalid value \"%s\" for %s",
+                   it->second.c_str(), key.c_str());
+        return defaultValue;
+    }
+    return value;
+}
+
+void ProxyPrefixFactory::applyConfig(const std::map<std::string, std::string>& config) {
+    XrdCl::Log* log = DefaultEnv::GetLog();
+    // load config for Fileplugin
+    auto prefix = config.find("proxyPrefix");
+    auto routing = config.find("proxyRouting");
+    ProxyPrefix::ProxyList::Routing mode = ProxyPrefix::ProxyList::Balanced;
+    if (routing != config.end() && routing->second == "hash")
+        mode = ProxyPrefix::ProxyList::Hashed;
+    else if (routing != config.end() && routing->second != "balance")
+        log->Error(1, "XrdProxyPrefix: unknown proxyRouting \"%s\", using balance",
+                   routing->second.c_str());
+    proxies = new ProxyPrefix::ProxyList(prefix != config.end() ? prefix->second : "", mode,
+                                         getConfigNumber(config, "proxyVirtualNodes", 160),
+                                         getConfigNumber(config, "proxyLoadFactor", 125));
+    auto bypassRules = config.find("proxyBypass");
+    bypass = new ProxyPrefix::BypassRules(bypassRules != config.end() ? bypassRules->second : "");
+    proxies->SetHealthCheck(getConfigNumber(config, "proxyHealthInterval", 10),
+                            getConfigNumber(config, "proxyHealthTimeout", 3));
+    ProxyPrefix::ProxyEndpoint::setHysteresis(getConfigNumber(config, "proxyHealthFall", 2),
+                                              getConfigNumber(config, "proxyHealthRise", 2));
+    ProxyPrefix::ProxyPrefixFile::setOpenRetries(getConfigNumber(config, "proxyOpenRetries", 0));
+    ProxyPrefix::ProxyPrefixFile::setVectorReadLimits(
+      getConfigNumber(config, "vectorReadGap", 4096),
+      getConfigNumber(config, "vectorReadMaxChunks", 1024),
+      getConfigNumber(config, "vectorReadMaxChunkSize", 2097136));
+    ProxyPrefix::StatBatch::setLimits(getConfigNumber(config, "statBatchWindow", 64),
+                                      getConfigNumber(config, "statBatchGroup", 0));
+    ProxyPrefix::WriteBehind::setLimits(getConfigNumber(config, "writeBehindChunkSize", 0),
+                                        getConfigNumber(config, "writeBehindMaxInFlight", 4));
+    ProxyPrefix::ReadAhead::setLimits(getConfigNumber(config, "readAheadBlockSize", 1048576),
+                                      getConfigNumber(config, "readAheadMaxBlocks", 8));
+    uint64_t cacheSize = getConfigNumber(config, "blockCacheSize", 0);
+    if (cacheSize)
+        blockCache = new ProxyPrefix::BlockCache(
+          cacheSize, getConfigNumber(config, "blockCacheBlockSize", 1048576));
+    if (config.find("diskCacheDir") != config.end())
+        diskCache = new ProxyPrefix::DiskCache(
+          config.find("diskCacheDir")->second,
+          getConfigNumber(config, "diskCacheBlockSize", 1048576),
+          getConfigNumber(config, "diskCacheSize", 10737418240ULL));
+    uint64_t metaEntries = getConfigNumber(config, "metaCacheSize", 0);
+    if (metaEntries)
+        metaCache = new ProxyPrefix::MetadataCache(
+          metaEntries, getConfigNumber(config, "metaCachePositiveTTL", 60),
+          getConfigNumber(config, "metaCacheNegativeTTL", 10));
+    uint64_t missEntries = getConfigNumber(config, "negCacheSize", 0);
+    if (missEntries)
+        negCache = new ProxyPrefix::NegativeCache(missEntries,
+                                                  getConfigNumber(config, "negCacheTTL", 10));
+    uint64_t poolSize = getConfigNumber(config, "handlePoolSize", 0);
+    if (poolSize)
+        handlePool = new ProxyPrefix::HandlePool(poolSize,
+                                                 getConfigNumber(config, "handlePoolGrace", 30));
+    if (config.find("statsFile") != config.end())
+        stats = new ProxyPrefix::Stats(*proxies, config.find("statsFile")->second,
+                                       getConfigNumber(config, "statsInterval", 60));
+}
+
 ProxyPrefixFactory::ProxyPrefixFactory(const std::map<std::string, std::string>& config)
-  : XrdCl::PlugInFactory() {
+  : XrdCl::PlugInFactory(), proxies(0), bypass(0), blockCache(0), diskCache(0), metaCache(0),
+    negCache(0), handlePool(0), stats(0) {
     XrdCl::Log* log = DefaultEnv::GetLog();
     log->Debug(1, "ProxyPrefixFactory::Constructor");
-    if (config.find("proxyPrefix") != config.end())
-        ProxyPrefix::ProxyPrefixFile::setProxyPrefix(config.find("proxyPrefix")->second);
-    if (config.find("proxyPrefix") != config.end())
-        ProxyPrefix::ProxyPrefixFs::setProxyPrefix(config.find("proxyPrefix")->second);
     if (config.size() == 0) {
         std::map<std::string, std::string> defaultconfig;
         log->Debug(1, "config size is zero... This is a \"default plug-in call\" "
                       "-> loading default config file @ XRD_DEFAULT_PLUGIN_CONF "
                       "Environment Variable ");
         loadDefaultConf(defaultconfig);
-        // load config for Fileplugin
-        if (defaultconfig.find("proxyPrefix") != defaultconfig.end())
-            ProxyPrefix::ProxyPrefixFile::setProxyPrefix(defaultconfig.find("proxyPrefix")->second);
-        // load config for Filesystemplugin
-        if (defaultconfig.find("proxyPrefix") != defaultconfig.end())
-            ProxyPrefix::ProxyPrefixFs::setProxyPrefix(defaultconfig.find("proxyPrefix")->second);
-    }
-    ProxyPrefix::ProxyPrefixFile::printInfo();
+        applyConfig(defaultconfig);
+    } else {
+        applyConfig(config);
+    }
+    for (size_t i = 0; i < proxies->Size(); ++i)
+        log->Debug(1, "XrdProxyPrefix: %s", proxies->Get(i)->GetHost().c_str());
 }
 ProxyPrefixFactory::~ProxyPrefixFactory() {
     XrdCl::Log* log = XrdCl::DefaultEnv::GetLog();
     log->Debug(1, "ProxyPrefixFactory::~ProxyPrefixFactory");
+    delete blockCache;
+    delete diskCache;
+    delete metaCache;
+    delete negCache;
+    delete handlePool;
+    delete stats;
+    delete proxies;
+    delete bypass;
 }
 
 XrdCl::FilePlugIn* ProxyPrefixFactory::CreateFile(const std::string& url) {
     XrdCl::Log* log = XrdCl::DefaultEnv::GetLog();
     log->Debug(1, "ProxyPrefixFactory::CreateFile");
-    return static_cast<XrdCl::FilePlugIn*>(new ProxyPrefix::ProxyPrefixFile());
+    proxies->StartHealthCheck();
+    if (stats)
+        stats->Start();
+    return static_cast<XrdCl::FilePlugIn*>(
+      new ProxyPrefix::ProxyPrefixFile(blockCache, diskCache, proxies, bypass, metaCache,
+                                       negCache, handlePool, stats));
 }
 
 XrdCl::FileSystemPlugIn* ProxyPrefixFactory::CreateFileSystem(const std::string& url) {
     XrdCl::Log* log = XrdCl::DefaultEnv::GetLog();
     log->Debug(1, "ProxyPreficFactory::CreateFilesys");
-    return static_cast<XrdCl::FileSystemPlugIn*>(new ProxyPrefix::ProxyPrefixFs(url));
+    proxies->StartHealthCheck();
+    if (stats)
+        stats->Start();
+    return static_cast<XrdCl::FileSystemPlugIn*>(
+      new ProxyPrefix::ProxyPrefixFs(url, proxies, bypass, metaCache, negCache, stats));
 }
 } // namespace PPFactory
 extern "C" {
@@ -30,6 +30,17 @@
 #include <utility>
 extern XrdCl::Log XrdClRFSLog;
 
+namespace ProxyPrefix {
+class BlockCache;
+class DiskCache;
+class HandlePool;
+class MetadataCache;
+class NegativeCache;
+class ProxyList;
+class BypassRules;
+class Stats;
+}
+
 namespace PPFactory {
 //----------------------------------------------------------------------------
 // Plugin factory
@@ -58,6 +69,37 @@ class ProxyPrefixFactory : public XrdCl::PlugInFactory {
     //------------------------------------------------------------------------
 
   private:
+    //------------------------------------------------------------------------
+    // pass the config values on to the file and file system plug-ins
+    void applyConfig(const std::map<std::string, std::string>& config);
+    //------------------------------------------------------------------------
+    // numeric config value or defaultValue if the key is not set
+    static uint64_t getConfigNumber(const std::map<std::string, std::string>& config,
+                                    const std::string& key, uint64_t defaultValue);
+    //------------------------------------------------------------------------
+    // the configured forward proxies
+    ProxyPrefix::ProxyList* proxies;
+    //------------------------------------------------------------------------
+    // targets accessed without a proxy
+    ProxyPrefix::BypassRules* bypass;
+    //------------------------------------------------------------------------
+    // block cache shared by all files, 0 if disabled
+    ProxyPrefix::BlockCache* blockCache;
+    //------------------------------------------------------------------------
+    // node-local disk cache, 0 if disabled
+    ProxyPrefix::DiskCache* diskCache;
+    //------------------------------------------------------------------------
+    // Stat, StatVFS and Locate results, 0 if disabled
+    ProxyPrefix::MetadataCache* metaCache;
+    //------------------------------------------------------------------------
+    // paths recently found missing, 0 if disabled
+    ProxyPrefix::NegativeCache* negCache;
+    //------------------------------------------------------------------------
+    // read-only handles kept open after close, 0 if disabled
+    ProxyPrefix::HandlePool* handlePool;
+    //------------------------------------------------------------------------
+    // latency histograms and counters, 0 if disabled
+    ProxyPrefix::Stats* stats;
 };
 };
 
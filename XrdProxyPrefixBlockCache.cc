@@ -0,0 +1,250 @@
+/********************************************************************************
+ *    Copyright (C) 2014 GSI Helmholtzzentrum fuer Schwerionenforschung GmbH *
+ *                                                                              *
+ *              This software is distributed under the terms of the *
+ *         GNU Lesser General Public Licence version 3 (LGPL) version 3, *
+ *                  copied verbatim in the file "LICENSE" *
+ ********************************************************************************/
+
+#include "XrdProxyPrefixBlockCache.hh"
+#include <algorithm>
+#include <cstring>
+
+using namespace XrdCl;
+
+namespace ProxyPrefix {
+void FetchTracker::Add() {
+    std::lock_guard<std::mutex> lock(mtx);
+    ++count;
+}
+
+void FetchTracker::Done() {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (--count == 0)
+        drained.notify_all();
+}
+
+void FetchTracker::Drain() {
+    std::unique_lock<std::mutex> lock(mtx);
+    drained.wait(lock, [this] { return count == 0; });
+}
+
+struct BlockCache::Entry {
+    Entry(const Key& k) : key(k), ready(false), cached(true) {}
+    Key key;
+    BlockData data;
+    bool ready;
+    bool cached;
+    std::vector<Request*> waiters;
+    std::list<EntryPtr>::iterator lru;
+};
+
+//----------------------------------------------------------------------------
+// A read waiting for its blocks, assembles the data into the user buffer and
+// notifies the user handler once the last block arrived
+//----------------------------------------------------------------------------
+class BlockCache::Request {
+  private:
+    uint64_t offset;
+    uint32_t length;
+    char* buffer;
+    XrdCl::ResponseHandler* handler;
+    uint32_t blockSize;
+    uint64_t first;
+    std::vector<BlockData> blocks;
+    XRootDStatus* error;
+    std::mutex mtx;
+    size_t pending;
+
+  public:
+    Request(uint64_t off, uint32_t len, void* buf, XrdCl::ResponseHandler* h, uint32_t bs,
+            uint64_t firstBlock, size_t count)
+      : offset(off), length(len), buffer(static_cast<char*>(buf)), handler(h), blockSize(bs),
+        first(firstBlock), blocks(count), error(0), pending(count + 1) {}
+
+    ~Request() { delete error; }
+
+    void OnBlock(uint64_t index, const BlockData& data, const XRootDStatus& status) {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            blocks[index - first] = data;
+            if (!status.IsOK() && !error)
+                error = new XRootDStatus(status);
+        }
+        Done();
+    }
+
+    void Done() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (--pending)
+                return;
+        }
+        if (error) {
+            XRootDStatus* st = error;
+            error = 0;
+            handler->HandleResponseWithHosts(st, 0, new HostList());
+            delete this;
+            return;
+        }
+        uint64_t end = offset + length;
+        uint64_t pos = offset;
+        for (size_t i = 0; i < blocks.size(); ++i) {
+            uint64_t start = (first + i) * blockSize;
+            uint64_t to = std::min<uint64_t>(end, start + blocks[i]->size());
+            if (to > pos) {
+                memcpy(buffer + (pos - offset), blocks[i]->data() + (pos - start), to - pos);
+                pos = to;
+            }
+            if (blocks[i]->size() < blockSize)
+                break;
+        }
+        AnyObject* obj = new AnyObject();
+        obj->Set(new ChunkInfo(offset, pos - offset, buffer));
+        handler->HandleResponseWithHosts(new XRootDStatus(), obj, new HostList());
+        delete this;
+    }
+};
+
+//----------------------------------------------------------------------------
+// Puts a fetched block into the cache
+//----------------------------------------------------------------------------
+class BlockCache::FetchHandler : public XrdCl::ResponseHandler {
+  private:
+    BlockCache* cache;
+    EntryPtr entry;
+    std::shared_ptr<std::vector<char> > data;
+    FetchTracker* tracker;
+
+  public:
+    FetchHandler(BlockCache* c, const EntryPtr& e, const std::shared_ptr<std::vector<char> >& d,
+                 FetchTracker* t)
+      : cache(c), entry(e), data(d), tracker(t) {}
+
+    virtual void HandleResponseWithHosts(XRootDStatus* status, AnyObject* response,
+                                         HostList* hostList) {
+        // the file may go away as soon as the fetch is accounted for, the
+        // cache itself lives as long as the plug-in factory
+        tracker->Done();
+        BlockData block;
+        if (status->IsOK()) {
+            ChunkInfo* chunk = 0;
+            if (response)
+                response->Get(chunk);
+            if (chunk && chunk->length < data->size()) {
+                data->resize(chunk->length);
+                data->shrink_to_fit();
+            }
+            block = data;
+        }
+        cache->Fill(entry, block, *status);
+        delete status;
+        delete response;
+        delete hostList;
+        delete this;
+    }
+};
+
+BlockCache::BlockCache(uint64_t b, uint32_t bs)
+  : budget(b), blockSize(std::max<uint32_t>(bs, 1)), used(0) {}
+
+XRootDStatus BlockCache::Read(const std::string& key, ReadSource& source, FetchTracker& tracker,
+                              uint64_t offset, uint32_t length, void* buffer,
+                              XrdCl::ResponseHandler* handler, uint16_t timeout) {
+    uint64_t first = offset / blockSize;
+    uint64_t last = length ? (offset + length - 1) / blockSize : first;
+    Request* req = new Request(offset, length, buffer, handler, blockSize, first, last - first + 1);
+
+    std::vector<EntryPtr> fetch;
+    std::vector<EntryPtr> hits;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        for (uint64_t i = first; i <= last; ++i) {
+            Key k(key, i);
+            auto it = entries.find(k);
+            if (it == entries.end()) {
+                EntryPtr entry = std::make_shared<Entry>(k);
+                entries[k] = entry;
+                entry->waiters.push_back(req);
+                fetch.push_back(entry);
+            } else if (it->second->ready) {
+                lru.splice(lru.begin(), lru, it->second->lru);
+                hits.push_back(it->second);
+            } else {
+                it->second->waiters.push_back(req);
+            }
+        }
+    }
+
+    XRootDStatus ok;
+    for (auto& entry : hits)
+        req->OnBlock(entry->key.second, entry->data, ok);
+
+    for (auto& entry : fetch) {
+        std::shared_ptr<std::vector<char> > data = std::make_shared<std::vector<char> >(blockSize);
+        FetchHandler* fetchHandler = new FetchHandler(this, entry, data, &tracker);
+        tracker.Add();
+        XRootDStatus st = source.Read(entry->key.second * blockSize, blockSize, data->data(),
+                                      fetchHandler, timeout);
+        if (!st.IsOK()) {
+            delete fetchHandler;
+            tracker.Done();
+            Fill(entry, BlockData(), st);
+        }
+    }
+    req->Done();
+    return XRootDStatus();
+}
+
+void BlockCache::Invalidate(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = entries.lower_bound(Key(key, 0));
+    while (it != entries.end() && it->first.first == key) {
+        EntryPtr& entry = it->second;
+        entry->cached = false;
+        if (entry->ready) {
+            used -= entry->data->capacity();
+            lru.erase(entry->lru);
+        }
+        it = entries.erase(it);
+    }
+}
+
+//----------------------------------------------------------------------------
+// Hand the fetched block to the reads waiting for it and keep it if it is
+// still wanted
+//----------------------------------------------------------------------------
+void BlockCache::Fill(const EntryPtr& entry, const BlockData& data,
+                      const XrdCl::XRootDStatus& status) {
+    std::vector<Request*> waiters;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        waiters.swap(entry->waiters);
+        if (entry->cached) {
+            if (status.IsOK()) {
+                entry->data = data;
+                entry->ready = true;
+                lru.push_front(entry);
+                entry->lru = lru.begin();
+                used += data->capacity();
+                Evict();
+            } else {
+                entry->cached = false;
+                entries.erase(entry->key);
+            }
+        }
+    }
+    for (auto req : waiters)
+        req->OnBlock(entry->key.second, data, status);
+}
+
+void BlockCache::Evict() {
+    while (used > budget && !lru.empty()) {
+        EntryPtr entry = lru.back();
+        lru.pop_back();
+        used -= entry->data->capacity();
+        entry->cached = false;
+        entries.erase(entry->key);
+    }
+}
+}
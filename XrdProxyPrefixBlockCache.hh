@@ -0,0 +1,84 @@
+/********************************************************************************
+ *    Copyright (C) 2014 GSI Helmholtzzentrum fuer Schwerionenforschung GmbH *
+ *                                                                              *
+ *              This software is distributed under the terms of the *
+ *         GNU Lesser General Public Licence version 3 (LGPL) version 3, *
+ *                  copied verbatim in the file "LICENSE" *
+ ********************************************************************************/
+#ifndef __XRDPROXYPREFIX_BLOCKCACHE_HH___
+#define __XRDPROXYPREFIX_BLOCKCACHE_HH___
+#include "XrdProxyPrefixReadSource.hh"
+#include <condition_variable>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace ProxyPrefix {
+//----------------------------------------------------------------------------
+// Counts the fetches a file has in flight, so that it can wait for them
+// before it is closed
+//----------------------------------------------------------------------------
+class FetchTracker {
+  public:
+    FetchTracker() : count(0) {}
+    void Add();
+    void Done();
+    void Drain();
+
+  private:
+    std::mutex mtx;
+    std::condition_variable drained;
+    uint32_t count;
+};
+
+//----------------------------------------------------------------------------
+// In-memory block cache shared by all the files of the process. Blocks are
+// keyed by the target location and the block index and evicted in LRU
+// order once the memory budget is exceeded. Concurrent misses on the same
+// block are served by a single fetch.
+//----------------------------------------------------------------------------
+class BlockCache {
+  public:
+    typedef std::shared_ptr<const std::vector<char> > BlockData;
+
+    //------------------------------------------------------------------------
+    // Constructor
+    //------------------------------------------------------------------------
+    BlockCache(uint64_t budget, uint32_t blockSize);
+
+    //------------------------------------------------------------------------
+    // Read through the cache, the missing blocks are fetched from source
+    //------------------------------------------------------------------------
+    XrdCl::XRootDStatus Read(const std::string& key, ReadSource& source, FetchTracker& tracker,
+                             uint64_t offset, uint32_t length, void* buffer,
+                             XrdCl::ResponseHandler* handler, uint16_t timeout);
+
+    //------------------------------------------------------------------------
+    // Drop all the blocks of the given location
+    //------------------------------------------------------------------------
+    void Invalidate(const std::string& key);
+
+  private:
+    struct Entry;
+    typedef std::shared_ptr<Entry> EntryPtr;
+    typedef std::pair<std::string, uint64_t> Key;
+    class Request;
+    class FetchHandler;
+    friend class FetchHandler;
+
+    void Fill(const EntryPtr& entry, const BlockData& data, const XrdCl::XRootDStatus& status);
+    void Evict();
+
+    uint64_t budget;
+    uint32_t blockSize;
+    uint64_t used;
+    std::mutex mtx;
+    std::map<Key, EntryPtr> entries;
+    std::list<EntryPtr> lru;
+};
+}
+
+#endif // __XRDPROXYPREFIX_BLOCKCACHE_HH___
@@ -0,0 +1,213 @@
+/********************************************************************************
+ *    Copyright (C) 2014 GSI Helmholtzzentrum fuer Schwerionenforschung GmbH *
+ *                                                                              *
+ *              This software is distributed under the terms of the *
+ *         GNU Lesser General Public Licence version 3 (LGPL) version 3, *
+ *                  copied verbatim in the file "LICENSE" *
+ ********************************************************************************/
+
+#include "XrdProxyPrefixBypass.hh"
+#include "XrdCl/XrdClDefaultEnv.hh"
+#include "XrdCl/XrdClLog.hh"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+char lower(char c) { return std::tolower(static_cast<unsigned char>(c)); }
+}
+
+namespace ProxyPrefix {
+void BypassRules::CharTrie::Insert(const std::string& key) {
+    uint32_t node = 0;
+    for (char c : key) {
+        uint32_t next = Child(node, c);
+        if (!next) {
+            next = nodes.size();
+            auto& children = nodes[node].children;
+            children.insert(std::lower_bound(children.begin(), children.end(),
+                                             std::make_pair(c, (uint32_t)0)),
+                            std::make_pair(c, next));
+            nodes.push_back(Node());
+        }
+        node = next;
+    }
+    nodes[node].terminal = true;
+}
+
+uint32_t BypassRules::CharTrie::Child(uint32_t node, char c) const {
+    auto& children = nodes[node].children;
+    auto it =
+      std::lower_bound(children.begin(), children.end(), std::make_pair(c, (uint32_t)0));
+    return it != children.end() && it->first == c ? it->second : 0;
+}
+
+void BypassRules::BitTrie::Insert(const unsigned char* addr, uint32_t bits) {
+    uint32_t node = 0;
+    for (uint32_t i = 0; i < bits; ++i) {
+        int bit = (addr[i / 8] >> (7 - i % 8)) & 1;
+        if (!nodes[node].child[bit]) {
+            nodes[node].child[bit] = nodes.size();
+            nodes.push_back(Node());
+        }
+        node = nodes[node].child[bit];
+    }
+    nodes[node].terminal = true;
+}
+
+bool BypassRules::BitTrie::Match(const unsigned char* addr, uint32_t bits) const {
+    uint32_t node = 0;
+    for (uint32_t i = 0; !nodes[node].terminal; ++i) {
+        if (i == bits)
+            return false;
+        node = nodes[node].child[(addr[i / 8] >> (7 - i % 8)) & 1];
+        if (!node)
+            return false;
+    }
+    return true;
+}
+
+BypassRules::BypassRules(const std::string& config) {
+    XrdCl::Log* log = XrdCl::DefaultEnv::GetLog();
+    size_t pos = 0;
+    while (pos < config.size()) {
+        size_t start = config.find_first_not_of(", \t", pos);
+        if (start == std::string::npos)
+            break;
+        pos = config.find_first_of(", \t", start);
+        std::string rule = config.substr(start, pos - start);
+        log->Debug(1, "XrdProxyPrefix: bypass %s", rule.c_str());
+        if (rule[0] == '/') {
+            rule.erase(0, rule.find_first_not_of('/'));
+            paths.Insert(rule);
+            continue;
+        }
+
+        std::transform(rule.begin(), rule.end(), rule.begin(), lower);
+        if (rule.find_first_of("*?") != std::string::npos) {
+            globs.push_back(rule);
+        } else if (rule.find_first_of("/:") != std::string::npos) {
+            if (!AddRange(rule))
+                log->Error(1, "XrdProxyPrefix: ignoring invalid bypass rule %s", rule.c_str());
+        } else if (!AddRange(rule)) {
+            rule.erase(0, rule.find_first_not_of('.'));
+            std::reverse(rule.begin(), rule.end());
+            if (!rule.empty())
+                domains.Insert(rule);
+        }
+    }
+}
+
+//----------------------------------------------------------------------------
+// Address with an optional prefix length, e.g. 10.0.0.0/8 or fd00::/8
+//----------------------------------------------------------------------------
+bool BypassRules::AddRange(const std::string& rule) {
+    size_t slash = rule.find('/');
+    std::string addr = rule.substr(0, slash);
+    if (addr.size() > 2 && addr.front() == '[' && addr.back() == ']')
+        addr = addr.substr(1, addr.size() - 2);
+    unsigned char buf[16];
+    bool v6 = addr.find(':') != std::string::npos;
+    if (inet_pton(v6 ? AF_INET6 : AF_INET, addr.c_str(), buf) != 1)
+        return false;
+    uint32_t max = v6 ? 128 : 32;
+    uint32_t bits = max;
+    if (slash != std::string::npos) {
+        char* end = 0;
+        const char* len = rule.c_str() + slash + 1;
+        bits = std::strtoul(len, &end, 10);
+        if (end == len || *end != 0 || bits > max)
+            return false;
+    }
+    (v6 ? ipv6 : ipv4).Insert(buf, bits);
+    return true;
+}
+
+bool BypassRules::MatchHost(const std::string& protocol, const std::string& host) const {
+    if (protocol == "file")
+        return true;
+    if (MatchDomain(host) || MatchAddress(host))
+        return true;
+    for (auto& glob : globs)
+        if (MatchGlob(glob, host))
+            return true;
+    return false;
+}
+
+bool BypassRules::MatchPath(const std::string& path) const {
+    size_t i = 0;
+    while (i < path.size() && path[i] == '/')
+        ++i;
+    uint32_t node = 0;
+    for (; !paths.IsTerminal(node); ++i) {
+        if (i == path.size())
+            return false;
+        node = paths.Child(node, path[i]);
+        if (!node)
+            return false;
+    }
+    return true;
+}
+
+//----------------------------------------------------------------------------
+// Walk the host backwards, a rule matches if it ends at a label boundary
+//----------------------------------------------------------------------------
+bool BypassRules::MatchDomain(const std::string& host) const {
+    uint32_t node = 0;
+    for (size_t i = host.size(); i > 0; --i) {
+        node = domains.Child(node, lower(host[i - 1]));
+        if (!node)
+            return false;
+        if (domains.IsTerminal(node) && (i == 1 || host[i - 2] == '.'))
+            return true;
+    }
+    return false;
+}
+
+bool BypassRules::MatchAddress(const std::string& host) const {
+    const char* begin = host.c_str();
+    size_t len = host.size();
+    if (len > 2 && begin[0] == '[' && begin[len - 1] == ']') {
+        ++begin;
+        len -= 2;
+    }
+    char text[INET6_ADDRSTRLEN];
+    if (len == 0 || len >= sizeof(text))
+        return false;
+    memcpy(text, begin, len);
+    text[len] = 0;
+    unsigned char addr[16];
+    if (inet_pton(AF_INET, text, addr) == 1)
+        return ipv4.Match(addr, 32);
+    if (inet_pton(AF_INET6, text, addr) == 1)
+        return ipv6.Match(addr, 128);
+    return false;
+}
+
+//----------------------------------------------------------------------------
+// Iterative glob matching, backtracks to the last star only
+//----------------------------------------------------------------------------
+bool BypassRules::MatchGlob(const std::string& glob, const std::string& host) const {
+    size_t g = 0, h = 0;
+    size_t star = std::string::npos, mark = 0;
+    while (h < host.size()) {
+        if (g < glob.size() && (glob[g] == '?' || glob[g] == lower(host[h]))) {
+            ++g;
+            ++h;
+        } else if (g < glob.size() && glob[g] == '*') {
+            star = g++;
+            mark = h;
+        } else if (star != std::string::npos) {
+            g = star + 1;
+            h = ++mark;
+        } else {
+            return false;
+        }
+    }
+    while (g < glob.size() && glob[g] == '*')
+        ++g;
+    return g == glob.size();
+}
+}
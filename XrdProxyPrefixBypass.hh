@@ -0,0 +1,101 @@
+/********************************************************************************
+ *    Copyright (C) 2014 GSI Helmholtzzentrum fuer Schwerionenforschung GmbH *
+ *                                                                              *
+ *              This software is distributed under the terms of the *
+ *         GNU Lesser General Public Licence version 3 (LGPL) version 3, *
+ *                  copied verbatim in the file "LICENSE" *
+ ********************************************************************************/
+#ifndef __XRDPROXYPREFIX_BYPASS_HH___
+#define __XRDPROXYPREFIX_BYPASS_HH___
+#include "XrdCl/XrdClURL.hh"
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ProxyPrefix {
+//----------------------------------------------------------------------------
+// Targets that are accessed directly instead of through a proxy. The rules
+// are compiled once, matching does not allocate. Local files always go
+// direct.
+//----------------------------------------------------------------------------
+class BypassRules {
+  public:
+    //------------------------------------------------------------------------
+    // Constructor, takes a comma or blank separated list of rules:
+    //   /path/prefix      paths starting with the prefix
+    //   10.0.0.0/8, ::1   addresses in the range, hosts given as literal
+    //                     addresses only, names are not resolved
+    //   host*.example.*   hosts matching the glob (* and ?)
+    //   example.org       the domain and all hosts below it
+    //------------------------------------------------------------------------
+    BypassRules(const std::string& config);
+
+    bool HasPathRules() const { return paths.Size() > 1 || paths.IsTerminal(0); }
+
+    //------------------------------------------------------------------------
+    // Whether the host (or protocol) of the target is accessed directly
+    //------------------------------------------------------------------------
+    bool MatchHost(const std::string& protocol, const std::string& host) const;
+
+    //------------------------------------------------------------------------
+    // Whether the path is accessed directly
+    //------------------------------------------------------------------------
+    bool MatchPath(const std::string& path) const;
+
+    bool Match(const XrdCl::URL& url) const {
+        return MatchHost(url.GetProtocol(), url.GetHostName()) || MatchPath(url.GetPath());
+    }
+
+  private:
+    //------------------------------------------------------------------------
+    // Character trie, children are kept in small sorted arrays
+    //------------------------------------------------------------------------
+    class CharTrie {
+      public:
+        CharTrie() : nodes(1) {}
+        void Insert(const std::string& key);
+        uint32_t Child(uint32_t node, char c) const;
+        bool IsTerminal(uint32_t node) const { return nodes[node].terminal; }
+        size_t Size() const { return nodes.size(); }
+
+      private:
+        struct Node {
+            Node() : terminal(false) {}
+            std::vector<std::pair<char, uint32_t> > children;
+            bool terminal;
+        };
+        std::vector<Node> nodes;
+    };
+
+    //------------------------------------------------------------------------
+    // Binary radix trie over address bits, a terminal node ends a prefix
+    //------------------------------------------------------------------------
+    class BitTrie {
+      public:
+        BitTrie() : nodes(1) {}
+        void Insert(const unsigned char* addr, uint32_t bits);
+        bool Match(const unsigned char* addr, uint32_t bits) const;
+
+      private:
+        struct Node {
+            Node() : terminal(false) { child[0] = child[1] = 0; }
+            uint32_t child[2];
+            bool terminal;
+        };
+        std::vector<Node> nodes;
+    };
+
+    bool AddRange(const std::string& rule);
+    bool MatchDomain(const std::string& host) const;
+    bool MatchAddress(const std::string& host) const;
+    bool MatchGlob(const std::string& glob, const std::string& host) const;
+
+    CharTrie domains; //< reversed domain names
+    CharTrie paths;   //< path prefixes without leading slashes
+    BitTrie ipv4;
+    BitTrie ipv6;
+    std::vector<std::string> globs;
+};
+}
+
+#endif // __XRDPROXYPREFIX_BYPASS_HH___
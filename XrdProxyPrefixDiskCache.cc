@@ -0,0 +1,504 @@
+/********************************************************************************
+ *    Copyright (C) 2014 GSI Helmholtzzentrum fuer Schwerionenforschung GmbH *
+ *                                                                              *
+ *              This software is distributed under the terms of the *
+ *         GNU Lesser General Public Licence version 3 (LGPL) version 3, *
+ *                  copied verbatim in the file "LICENSE" *
+ ********************************************************************************/
+
+#include "XrdProxyPrefixDiskCache.hh"
+#include "XrdCl/XrdClDefaultEnv.hh"
+#include "XrdCl/XrdClLog.hh"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace XrdCl;
+
+namespace {
+const char diskCacheMagic[8] = { 'X', 'P', 'P', 'D', 'C', '0', '2', 0 };
+
+bool readAll(int fd, char* buf, size_t len, off_t off) {
+    while (len) {
+        ssize_t n = pread(fd, buf, len, off);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        buf += n;
+        len -= n;
+        off += n;
+    }
+    return true;
+}
+
+bool writeAll(int fd, const char* buf, size_t len, off_t off) {
+    while (len) {
+        ssize_t n = pwrite(fd, buf, len, off);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        buf += n;
+        len -= n;
+        off += n;
+    }
+    return true;
+}
+
+//----------------------------------------------------------------------------
+// Holds an flock on the index for the lifetime of the object
+//----------------------------------------------------------------------------
+class FileLock {
+  public:
+    FileLock(int f, int op) : fd(f) {
+        while (flock(fd, op) < 0 && errno == EINTR)
+            ;
+    }
+    ~FileLock() { flock(fd, LOCK_UN); }
+
+  private:
+    int fd;
+};
+
+//----------------------------------------------------------------------------
+// Whether the file behind the descriptor has been removed
+//----------------------------------------------------------------------------
+bool unlinked(int fd) {
+    struct stat st;
+    return fstat(fd, &st) || st.st_nlink == 0;
+}
+
+//----------------------------------------------------------------------------
+// Space taken on disk by the file, 0 if it is gone
+//----------------------------------------------------------------------------
+uint64_t diskUsage(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) ? 0 : uint64_t(st.st_blocks) * 512;
+}
+
+uint64_t fnv1a(const std::string& s) {
+    uint64_t h = 14695981039346656037ULL;
+    for (unsigned char c : s) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+}
+
+namespace ProxyPrefix {
+DiskCacheEntry::DiskCacheEntry(int d, int i, const std::string& loc, uint32_t bs, uint64_t sz,
+                               uint64_t mt, DiskCache* c)
+  : cache(c), dataFd(d), indexFd(i), location(loc), blockSize(bs), size(sz), mtime(mt) {}
+
+DiskCacheEntry::~DiskCacheEntry() {
+    close(dataFd);
+    close(indexFd);
+}
+
+std::shared_ptr<DiskCacheEntry> DiskCacheEntry::Open(const std::string& base,
+                                                     const std::string& location,
+                                                     uint32_t blockSize, uint64_t size,
+                                                     uint64_t mtime, DiskCache* cache) {
+    //------------------------------------------------------------------------
+    // The files may be evicted between the open and the lock, open them
+    // again until the lock is held on files that are still there
+    //------------------------------------------------------------------------
+    int indexFd = -1;
+    int dataFd = -1;
+    for (int attempt = 0; attempt < 3; ++attempt) {
+        if (indexFd >= 0)
+            close(indexFd);
+        if (dataFd >= 0)
+            close(dataFd);
+        dataFd = -1;
+        indexFd = open((base + ".idx").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (indexFd < 0)
+            return std::shared_ptr<DiskCacheEntry>();
+        dataFd = open((base + ".data").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (dataFd < 0) {
+            close(indexFd);
+            return std::shared_ptr<DiskCacheEntry>();
+        }
+        while (flock(dataFd, LOCK_SH) < 0 && errno == EINTR)
+            ;
+        if (!unlinked(indexFd) && !unlinked(dataFd))
+            break;
+    }
+    std::shared_ptr<DiskCacheEntry> entry(
+      new DiskCacheEntry(dataFd, indexFd, location, blockSize, size, mtime, cache));
+
+    FileLock lock(indexFd, LOCK_EX);
+    if (entry->IsCurrent()) {
+        // the index time orders the entries for eviction
+        futimens(indexFd, 0);
+        return entry;
+    }
+
+    //------------------------------------------------------------------------
+    // New file, another location or the remote file changed, start over
+    // with an empty bitmap and a sparse data file of the right size
+    //------------------------------------------------------------------------
+    Header h;
+    memcpy(h.magic, diskCacheMagic, sizeof(h.magic));
+    h.blockSize = blockSize;
+    h.locationLength = location.size();
+    h.size = size;
+    h.mtime = mtime;
+    uint64_t blocks = (size + blockSize - 1) / blockSize;
+    if (ftruncate(indexFd, 0) || ftruncate(indexFd, entry->BitmapOffset() + (blocks + 7) / 8) ||
+        ftruncate(dataFd, 0) || ftruncate(dataFd, size) ||
+        !writeAll(indexFd, reinterpret_cast<const char*>(&h), sizeof(h), 0) ||
+        !writeAll(indexFd, location.data(), location.size(), sizeof(h)))
+        return std::shared_ptr<DiskCacheEntry>();
+    return entry;
+}
+
+int64_t DiskCacheEntry::Read(uint64_t offset, uint32_t length, char* buffer) {
+    uint64_t end = std::min<uint64_t>(offset + length, size);
+    if (end <= offset)
+        return 0;
+    uint64_t first = offset / blockSize;
+    uint64_t last = (end - 1) / blockSize;
+
+    FileLock lock(indexFd, LOCK_SH);
+    if (!IsCurrent())
+        return -1;
+    std::vector<char> bitmap(last / 8 - first / 8 + 1);
+    if (!readAll(indexFd, bitmap.data(), bitmap.size(), BitmapOffset() + first / 8))
+        return -1;
+    for (uint64_t i = first; i <= last; ++i)
+        if (!(bitmap[i / 8 - first / 8] & (1 << (i % 8))))
+            return -1;
+    if (!readAll(dataFd, buffer, end - offset, offset))
+        return -1;
+    return end - offset;
+}
+
+void DiskCacheEntry::Store(uint64_t offset, const char* data, uint32_t length) {
+    uint64_t first = offset / blockSize;
+    uint64_t last = first;
+    uint64_t end = offset;
+    for (uint64_t i = first;; ++i) {
+        uint64_t blockEnd = std::min<uint64_t>((i + 1) * blockSize, size);
+        if (blockEnd <= end || blockEnd > offset + length)
+            break;
+        end = blockEnd;
+        last = i;
+    }
+    if (end == offset)
+        return;
+
+    {
+        FileLock lock(indexFd, LOCK_EX);
+        if (!IsCurrent() || !writeAll(dataFd, data, end - offset, offset))
+            return;
+        std::vector<char> bitmap(last / 8 - first / 8 + 1);
+        if (!readAll(indexFd, bitmap.data(), bitmap.size(), BitmapOffset() + first / 8))
+            return;
+        for (uint64_t i = first; i <= last; ++i)
+            bitmap[i / 8 - first / 8] |= 1 << (i % 8);
+        writeAll(indexFd, bitmap.data(), bitmap.size(), BitmapOffset() + first / 8);
+    }
+    // outside the lock, the trim takes the locks of other entries
+    cache->Stored(end - offset);
+}
+
+//----------------------------------------------------------------------------
+// Check whether another process reset the files for a different version of
+// the remote file or for another location, needs to be called with the
+// index locked
+//----------------------------------------------------------------------------
+bool DiskCacheEntry::IsCurrent() {
+    Header h;
+    if (!readAll(indexFd, reinterpret_cast<char*>(&h), sizeof(h), 0) ||
+        memcmp(h.magic, diskCacheMagic, sizeof(h.magic)) || h.blockSize != blockSize ||
+        h.size != size || h.mtime != mtime || h.locationLength != location.size())
+        return false;
+    std::vector<char> stored(location.size());
+    return readAll(indexFd, stored.data(), stored.size(), sizeof(h)) &&
+           std::equal(stored.begin(), stored.end(), location.begin());
+}
+
+DiskCache::DiskCache(const std::string& d, uint32_t bs, uint64_t max)
+  : dir(d), blockSize(std::max<uint32_t>(bs, 1)), maxSize(max), pending(0) {
+    if (mkdir(dir.c_str(), 0755) && errno != EEXIST) {
+        XrdCl::Log* log = XrdCl::DefaultEnv::GetLog();
+        log->Error(1, "XrdProxyPrefix: cannot create the disk cache directory %s: %s",
+                   dir.c_str(), strerror(errno));
+    }
+    // the limit may have been lowered or other processes left too much
+    if (maxSize)
+        Trim();
+}
+
+void DiskCache::Stored(uint64_t bytes) {
+    if (!maxSize)
+        return;
+    uint64_t interval = std::max<uint64_t>(maxSize / 16, blockSize);
+    if (pending.fetch_add(bytes) + bytes < interval)
+        return;
+    pending = 0;
+    Trim();
+}
+
+//----------------------------------------------------------------------------
+// Evict the least recently used entries until they fit below 90% of the
+// limit. One process trims at a time, the others skip their turn. Entries
+// another process holds open keep their shared lock on the data file and
+// are skipped; the index lock is taken so no read or store is in progress.
+//----------------------------------------------------------------------------
+void DiskCache::Trim() {
+    std::unique_lock<std::mutex> guard(trimMtx, std::try_to_lock);
+    if (!guard.owns_lock())
+        return;
+    int trimFd = open((dir + "/.trim").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (trimFd < 0)
+        return;
+    if (flock(trimFd, LOCK_EX | LOCK_NB) < 0) {
+        close(trimFd);
+        return;
+    }
+
+    struct Candidate {
+        time_t lastUse;
+        std::string base;
+        uint64_t bytes;
+        bool operator<(const Candidate& o) const { return lastUse < o.lastUse; }
+    };
+    std::vector<Candidate> candidates;
+    uint64_t total = 0;
+    if (DIR* d = opendir(dir.c_str())) {
+        while (struct dirent* e = readdir(d)) {
+            std::string name = e->d_name;
+            if (name.size() != 20 || name.compare(16, 4, ".idx"))
+                continue;
+            std::string base = dir + "/" + name.substr(0, 16);
+            struct stat st;
+            if (stat((base + ".idx").c_str(), &st))
+                continue;
+            uint64_t bytes = uint64_t(st.st_blocks) * 512 + diskUsage(base + ".data");
+            candidates.push_back(Candidate{ st.st_mtime, base, bytes });
+            total += bytes;
+        }
+        closedir(d);
+    }
+
+    uint64_t target = maxSize - maxSize / 10;
+    size_t evicted = 0;
+    if (total > maxSize) {
+        std::sort(candidates.begin(), candidates.end());
+        for (auto& c : candidates) {
+            if (total <= target)
+                break;
+            int dataFd = open((c.base + ".data").c_str(), O_RDWR | O_CLOEXEC);
+            int indexFd = open((c.base + ".idx").c_str(), O_RDWR | O_CLOEXEC);
+            if (dataFd >= 0 && indexFd >= 0 && !flock(dataFd, LOCK_EX | LOCK_NB) &&
+                !flock(indexFd, LOCK_EX | LOCK_NB)) {
+                unlink((c.base + ".data").c_str());
+                unlink((c.base + ".idx").c_str());
+                total -= std::min(total, c.bytes);
+                ++evicted;
+            }
+            if (dataFd >= 0)
+                close(dataFd);
+            if (indexFd >= 0)
+                close(indexFd);
+        }
+    }
+    close(trimFd);
+
+    XrdCl::Log* log = XrdCl::DefaultEnv::GetLog();
+    if (evicted)
+        log->Debug(1, "XrdProxyPrefix: evicted %zu disk cache entries, %llu bytes left",
+                   evicted, (unsigned long long)total);
+    if (total > maxSize)
+        log->Warning(1, "XrdProxyPrefix: disk cache %s holds %llu bytes in use, more than %llu",
+                     dir.c_str(), (unsigned long long)total, (unsigned long long)maxSize);
+}
+
+std::shared_ptr<DiskCacheEntry> DiskCache::Attach(const std::string& location, uint64_t size,
+                                                  uint64_t mtime) {
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", (unsigned long long)fnv1a(location));
+    std::shared_ptr<DiskCacheEntry> entry =
+      DiskCacheEntry::Open(dir + "/" + name, location, blockSize, size, mtime, this);
+    XrdCl::Log* log = XrdCl::DefaultEnv::GetLog();
+    if (!entry)
+        log->Error(1, "XrdProxyPrefix: cannot use the disk cache for %s", location.c_str());
+    else
+        log->Debug(1, "XrdProxyPrefix: disk cache for %s is %s", location.c_str(), name);
+    return entry;
+}
+
+//----------------------------------------------------------------------------
+// Stores the block aligned data read from the file and hands the requested
+// part to the user
+//----------------------------------------------------------------------------
+class DiskCacheSource::FillHandler : public XrdCl::ResponseHandler {
+  private:
+    std::shared_ptr<DiskCacheEntry> entry;
+    uint64_t start;
+    uint64_t offset;
+    uint32_t size;
+    char* buffer;
+    XrdCl::ResponseHandler* handler;
+
+  public:
+    std::vector<char> data;
+
+    FillHandler(const std::shared_ptr<DiskCacheEntry>& e, uint64_t st, uint32_t len, uint64_t off,
+                uint32_t sz, void* buf, XrdCl::ResponseHandler* h)
+      : entry(e), start(st), offset(off), size(sz), buffer(static_cast<char*>(buf)), handler(h),
+        data(len) {}
+
+    virtual void HandleResponseWithHosts(XRootDStatus* status, AnyObject* response,
+                                         HostList* hostList) {
+        if (!status->IsOK()) {
+            delete response;
+            handler->HandleResponseWithHosts(status, 0, hostList);
+            delete this;
+            return;
+        }
+        ChunkInfo* chunk = 0;
+        if (response)
+            response->Get(chunk);
+        uint32_t bytesRead = chunk ? chunk->length : 0;
+        delete response;
+        entry->Store(start, data.data(), bytesRead);
+
+        uint64_t end = std::min<uint64_t>(offset + size, start + bytesRead);
+        uint32_t length = end > offset ? end - offset : 0;
+        memcpy(buffer, data.data() + (offset - start), length);
+        AnyObject* obj = new AnyObject();
+        obj->Set(new ChunkInfo(offset, length, buffer));
+        handler->HandleResponseWithHosts(status, obj, hostList);
+        delete this;
+    }
+};
+
+//----------------------------------------------------------------------------
+// Attaches the cache entry once the stat info is there
+//----------------------------------------------------------------------------
+class DiskCacheSource::AttachHandler : public XrdCl::ResponseHandler {
+  private:
+    BindingPtr binding;
+    DiskCache* cache;
+
+  public:
+    AttachHandler(const BindingPtr& b, DiskCache* c) : binding(b), cache(c) {}
+
+    virtual void HandleResponseWithHosts(XRootDStatus* status, AnyObject* response,
+                                         HostList* hostList) {
+        StatInfo* info = 0;
+        if (status->IsOK() && response)
+            response->Get(info);
+        std::shared_ptr<DiskCacheEntry> entry;
+        if (info)
+            entry = cache->Attach(binding->location, info->GetSize(), info->GetModTime());
+        {
+            std::lock_guard<std::mutex> lock(binding->mtx);
+            binding->entry = entry;
+            binding->attached = true;
+            binding->attaching = false;
+        }
+        delete status;
+        delete response;
+        delete hostList;
+        delete this;
+    }
+};
+
+DiskCacheSource::DiskCacheSource(XrdCl::File* f, DiskCache* c)
+  : file(f), cache(c), binding(std::make_shared<Binding>()), endpoint(0) {
+    binding->enabled = false;
+    binding->attaching = false;
+    binding->attached = false;
+}
+
+void DiskCacheSource::SetLocation(const std::string& loc, bool readOnly, ProxyEndpoint* e) {
+    BindingPtr b = std::make_shared<Binding>();
+    b->location = loc;
+    b->enabled = cache && readOnly;
+    b->attaching = false;
+    b->attached = false;
+    std::lock_guard<std::mutex> lock(mtx);
+    binding = b;
+    endpoint = e;
+}
+
+//----------------------------------------------------------------------------
+// The cache entry is attached on the first read, the stat info cached by the
+// open is good enough to validate it. XrdCl answers from that info right
+// away; if the open returned none, the reads go to the file until the Stat
+// is answered.
+//----------------------------------------------------------------------------
+std::shared_ptr<DiskCacheEntry> DiskCacheSource::GetEntry() {
+    BindingPtr b;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        b = binding;
+    }
+    {
+        std::lock_guard<std::mutex> lock(b->mtx);
+        if (!b->enabled || b->attached || b->attaching)
+            return b->entry;
+        b->attaching = true;
+    }
+    AttachHandler* handler = new AttachHandler(b, cache);
+    if (!file->Stat(false, handler).IsOK()) {
+        delete handler;
+        std::lock_guard<std::mutex> lock(b->mtx);
+        b->attached = true;
+        b->attaching = false;
+    }
+    std::lock_guard<std::mutex> lock(b->mtx);
+    return b->entry;
+}
+
+XRootDStatus DiskCacheSource::Read(uint64_t offset, uint32_t size, void* buffer,
+                                   XrdCl::ResponseHandler* handler, uint16_t timeout) {
+    std::shared_ptr<DiskCacheEntry> e = GetEntry();
+    if (!e || size == 0 || offset >= e->GetSize())
+        return Fetch(offset, size, buffer, handler, timeout);
+
+    int64_t n = e->Read(offset, size, static_cast<char*>(buffer));
+    if (n >= 0) {
+        AnyObject* obj = new AnyObject();
+        obj->Set(new ChunkInfo(offset, n, buffer));
+        handler->HandleResponseWithHosts(new XRootDStatus(), obj, new HostList());
+        return XRootDStatus();
+    }
+
+    uint64_t bs = e->GetBlockSize();
+    uint64_t start = offset / bs * bs;
+    uint64_t end = std::min((offset + size + bs - 1) / bs * bs, e->GetSize());
+    if (end - start > 0xffffffffULL)
+        return Fetch(offset, size, buffer, handler, timeout);
+    FillHandler* fillHandler =
+      new FillHandler(e, start, end - start, offset, size, buffer, handler);
+    XRootDStatus st = Fetch(start, end - start, fillHandler->data.data(), fillHandler, timeout);
+    if (!st.IsOK())
+        delete fillHandler;
+    return st;
+}
+
+XRootDStatus DiskCacheSource::Fetch(uint64_t offset, uint32_t size, void* buffer,
+                                    XrdCl::ResponseHandler* handler, uint16_t timeout) {
+    if (!endpoint)
+        return file->Read(offset, size, buffer, handler, timeout);
+    TrackedHandler* tracked = endpoint->Track(handler);
+    XRootDStatus st = file->Read(offset, size, buffer, tracked, timeout);
+    if (!st.IsOK())
+        tracked->Cancel();
+    return st;
+}
+}
@@ -0,0 +1,167 @@
+/********************************************************************************
+ *    Copyright (C) 2014 GSI Helmholtzzentrum fuer Schwerionenforschung GmbH *
+ *                                                                              *
+ *              This software is distributed under the terms of the *
+ *         GNU Lesser General Public Licence version 3 (LGPL) version 3, *
+ *                  copied verbatim in the file "LICENSE" *
+ ********************************************************************************/
+#ifndef __XRDPROXYPREFIX_DISKCACHE_HH___
+#define __XRDPROXYPREFIX_DISKCACHE_HH___
+#include "XrdCl/XrdClFile.hh"
+#include "XrdProxyPrefixProxies.hh"
+#include "XrdProxyPrefixReadSource.hh"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace ProxyPrefix {
+class DiskCache;
+
+//----------------------------------------------------------------------------
+// Cached copy of a single remote file on local disk: a sparse data file and
+// an index holding the location, size and modification time of the remote
+// file plus a bitmap of the blocks present. Processes on the node share the
+// files, access is serialized with flock on the index. The entry holds a
+// shared flock on the data file while it is open, which keeps it from being
+// evicted.
+//----------------------------------------------------------------------------
+class DiskCacheEntry {
+  public:
+    //------------------------------------------------------------------------
+    // Open or create the files, they are reset if they belong to another
+    // location, whose name hashes the same, or size or mtime changed. The
+    // data stored is accounted to the cache.
+    //------------------------------------------------------------------------
+    static std::shared_ptr<DiskCacheEntry> Open(const std::string& base,
+                                                const std::string& location, uint32_t blockSize,
+                                                uint64_t size, uint64_t mtime, DiskCache* cache);
+    ~DiskCacheEntry();
+
+    uint64_t GetSize() const { return size; }
+    uint32_t GetBlockSize() const { return blockSize; }
+
+    //------------------------------------------------------------------------
+    // Read the range if all its blocks are present, -1 otherwise
+    //------------------------------------------------------------------------
+    int64_t Read(uint64_t offset, uint32_t length, char* buffer);
+
+    //------------------------------------------------------------------------
+    // Store the data starting at the block aligned offset, only complete
+    // blocks and the last block of the file are kept
+    //------------------------------------------------------------------------
+    void Store(uint64_t offset, const char* data, uint32_t length);
+
+  private:
+    //------------------------------------------------------------------------
+    // The location follows the header, the bitmap follows the location
+    //------------------------------------------------------------------------
+    struct Header {
+        char magic[8];
+        uint32_t blockSize;
+        uint32_t locationLength;
+        uint64_t size;
+        uint64_t mtime;
+    };
+
+    DiskCacheEntry(int dataFd, int indexFd, const std::string& location, uint32_t blockSize,
+                   uint64_t size, uint64_t mtime, DiskCache* cache);
+    bool IsCurrent();
+    off_t BitmapOffset() const { return sizeof(Header) + location.size(); }
+
+    DiskCache* cache;
+    int dataFd;
+    int indexFd;
+    std::string location;
+    uint32_t blockSize;
+    uint64_t size;
+    uint64_t mtime;
+};
+
+//----------------------------------------------------------------------------
+// Node-local disk cache below a configured directory. The space taken by
+// the entries is kept below maxSize bytes, 0 for no limit: whenever a
+// sixteenth of it has been stored, the entries not in use by any process
+// are evicted, least recently attached or written first, until they take
+// less than 90% of it.
+//----------------------------------------------------------------------------
+class DiskCache {
+  public:
+    DiskCache(const std::string& dir, uint32_t blockSize, uint64_t maxSize);
+
+    //------------------------------------------------------------------------
+    // Cache entry for the location with the given size and mtime, 0 if the
+    // files cannot be used
+    //------------------------------------------------------------------------
+    std::shared_ptr<DiskCacheEntry> Attach(const std::string& location, uint64_t size,
+                                           uint64_t mtime);
+
+    //------------------------------------------------------------------------
+    // Account data written to an entry, may evict entries
+    //------------------------------------------------------------------------
+    void Stored(uint64_t bytes);
+
+  private:
+    void Trim();
+
+    std::string dir;
+    uint32_t blockSize;
+    uint64_t maxSize;
+    std::atomic<uint64_t> pending; //< stored since the last trim
+    std::mutex trimMtx;
+};
+
+//----------------------------------------------------------------------------
+// Reads of a single file: served from the disk cache when the blocks are
+// present, otherwise the block aligned range is read from the file and
+// stored. Files opened for writing are never cached.
+//----------------------------------------------------------------------------
+class DiskCacheSource : public ReadSource {
+  public:
+    DiskCacheSource(XrdCl::File* file, DiskCache* cache);
+
+    //------------------------------------------------------------------------
+    // Read from another file object, only while no reads are pending
+    //------------------------------------------------------------------------
+    void SetFile(XrdCl::File* f) { file = f; }
+
+    //------------------------------------------------------------------------
+    // Bind to the location the file is opened at, the remote reads are
+    // accounted to the endpoint if one is given
+    //------------------------------------------------------------------------
+    void SetLocation(const std::string& location, bool readOnly, ProxyEndpoint* endpoint);
+
+    virtual XrdCl::XRootDStatus Read(uint64_t offset, uint32_t size, void* buffer,
+                                     XrdCl::ResponseHandler* handler, uint16_t timeout);
+
+  private:
+    //------------------------------------------------------------------------
+    // The cache entry of the location the file is opened at. The Stat that
+    // attaches the entry may complete after the file was reopened elsewhere
+    // or the source is gone, so it only holds on to the binding.
+    //------------------------------------------------------------------------
+    struct Binding {
+        std::mutex mtx;
+        std::string location;
+        bool enabled;
+        bool attaching;
+        bool attached;
+        std::shared_ptr<DiskCacheEntry> entry;
+    };
+    typedef std::shared_ptr<Binding> BindingPtr;
+
+    class AttachHandler;
+    class FillHandler;
+    std::shared_ptr<DiskCacheEntry> GetEntry();
+    XrdCl::XRootDStatus Fetch(uint64_t offset, uint32_t size, void* buffer,
+                              XrdCl::ResponseHandler* handler, uint16_t timeout);
+
+    XrdCl::File* file;
+    DiskCache* cache;
+    std::mutex mtx;
+    BindingPtr binding;
+    ProxyEndpoint* endpoint;
+};
+}
+
+#endif // __XRDPROXYPREFIX_DISKCACHE_HH___
@@ -0,0 +1,154 @@
+/********************************************************************************
+ *    Copyright (C) 2014 GSI Helmholtzzentrum fuer Schwerionenforschung GmbH *
+ *                                                                              *
+ *              This software is distributed under the terms of the *
+ *         GNU Lesser General Public Licence version 3 (LGPL) version 3, *
+ *                  copied verbatim in the file "LICENSE" *
+ ********************************************************************************/
+
+#include "XrdProxyPrefixHandlePool.hh"
+#include "XrdCl/XrdClDefaultEnv.hh"
+#include "XrdCl/XrdClLog.hh"
+#include "XrdCl/XrdClPostMaster.hh"
+#include "XrdCl/XrdClTaskManager.hh"
+#include <algorithm>
+
+using namespace XrdCl;
+
+namespace {
+//----------------------------------------------------------------------------
+// Deletes the file once it is closed
+//----------------------------------------------------------------------------
+class CloseHandler : public XrdCl::ResponseHandler {
+  private:
+    std::unique_ptr<XrdCl::File> file;
+
+  public:
+    CloseHandler(std::unique_ptr<XrdCl::File> f) : file(std::move(f)) {}
+
+    virtual void HandleResponseWithHosts(XRootDStatus* status, AnyObject* response,
+                                         HostList* hostList) {
+        delete status;
+        delete response;
+        delete hostList;
+        delete this;
+    }
+};
+}
+
+namespace ProxyPrefix {
+//----------------------------------------------------------------------------
+// Closes the handles past their grace period, ends once the pool is gone
+//----------------------------------------------------------------------------
+class HandlePool::Sweeper : public XrdCl::Task {
+  private:
+    std::shared_ptr<State> state;
+    size_t maxHandles;
+    uint32_t interval;
+
+  public:
+    Sweeper(const std::shared_ptr<State>& s, size_t m, uint32_t i)
+      : state(s), maxHandles(m), interval(std::max<uint32_t>(i, 1)) {
+        SetName("XrdProxyPrefix handle pool");
+    }
+
+    virtual time_t Run(time_t now) {
+        HandleList evicted;
+        {
+            std::lock_guard<std::mutex> lock(state->mtx);
+            if (state->stopped)
+                return 0;
+            state->Evict(maxHandles, Clock::now(), evicted);
+        }
+        HandlePool::Close(evicted);
+        return now + interval;
+    }
+};
+
+HandlePool::HandlePool(size_t m, uint32_t g)
+  : maxHandles(m), grace(std::chrono::seconds(g)), state(std::make_shared<State>()),
+    sweeperStarted(false) {}
+
+HandlePool::~HandlePool() {
+    std::lock_guard<std::mutex> lock(state->mtx);
+    state->stopped = true;
+    for (auto& handle : state->lru)
+        handle.file.release();
+    state->lru.clear();
+    state->index.clear();
+}
+
+std::string HandlePool::Key(const std::string& url, XrdCl::OpenFlags::Flags flags) {
+    std::string key = std::to_string(flags);
+    key.reserve(key.size() + 1 + url.size());
+    key.append(1, ' ').append(url);
+    return key;
+}
+
+void HandlePool::State::Evict(size_t maxHandles, Clock::time_point now, HandleList& evicted) {
+    while (!lru.empty() && (lru.size() > maxHandles || lru.back().expires <= now)) {
+        auto range = index.equal_range(lru.back().key);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == std::prev(lru.end())) {
+                index.erase(it);
+                break;
+            }
+        }
+        evicted.splice(evicted.end(), lru, std::prev(lru.end()));
+    }
+}
+
+void HandlePool::Close(HandleList& handles) {
+    for (auto& handle : handles) {
+        XrdCl::File* file = handle.file.get();
+        CloseHandler* handler = new CloseHandler(std::move(handle.file));
+        XRootDStatus st = file->Close(handler);
+        if (!st.IsOK())
+            delete handler;
+    }
+}
+
+std::unique_ptr<XrdCl::File> HandlePool::Take(const std::string& key, ProxyEndpoint*& endpoint) {
+    std::unique_ptr<XrdCl::File> file;
+    endpoint = 0;
+    HandleList evicted;
+    {
+        std::lock_guard<std::mutex> lock(state->mtx);
+        state->Evict(maxHandles, Clock::now(), evicted);
+        auto it = state->index.find(key);
+        if (it != state->index.end()) {
+            file = std::move(it->second->file);
+            endpoint = it->second->endpoint;
+            state->lru.erase(it->second);
+            state->index.erase(it);
+        }
+    }
+    Close(evicted);
+    return file;
+}
+
+void HandlePool::Put(const std::string& key, std::unique_ptr<XrdCl::File> file,
+                     ProxyEndpoint* endpoint) {
+    if (!sweeperStarted.exchange(true)) {
+        XrdCl::PostMaster* postMaster = XrdCl::DefaultEnv::GetPostMaster();
+        uint32_t seconds = std::chrono::duration_cast<std::chrono::seconds>(grace).count();
+        if (postMaster)
+            postMaster->GetTaskManager()->RegisterTask(
+              new Sweeper(state, maxHandles, std::max<uint32_t>(seconds / 2, 1)), time(0),
+              true);
+    }
+    HandleList evicted;
+    {
+        std::lock_guard<std::mutex> lock(state->mtx);
+        state->lru.push_front(Handle());
+        Handle& handle = state->lru.front();
+        handle.key = key;
+        handle.file = std::move(file);
+        handle.endpoint = endpoint;
+        handle.expires = Clock::now() + grace;
+        state->index.insert(std::make_pair(key, state->lru.begin()));
+        state->Evict(maxHandles, Clock::now(), evicted);
+    }
+    Close(evicted);
+}
+}
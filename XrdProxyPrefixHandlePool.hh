@@ -0,0 +1,94 @@
+/********************************************************************************
+ *    Copyright (C) 2014 GSI Helmholtzzentrum fuer Schwerionenforschung GmbH *
+ *                                                                              *
+ *              This software is distributed under the terms of the *
+ *         GNU Lesser General Public Licence version 3 (LGPL) version 3, *
+ *                  copied verbatim in the file "LICENSE" *
+ ********************************************************************************/
+#ifndef __XRDPROXYPREFIX_HANDLEPOOL_HH___
+#define __XRDPROXYPREFIX_HANDLEPOOL_HH___
+#include "XrdCl/XrdClFile.hh"
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace ProxyPrefix {
+class ProxyEndpoint;
+
+//----------------------------------------------------------------------------
+// Read-only files closed by the user are kept open for a grace period and
+// handed to the next open of the same URL with the same flags. Idle
+// handles are closed in LRU order once the pool is full, and by a task of
+// the task manager once their grace period ran out.
+//----------------------------------------------------------------------------
+class HandlePool {
+  public:
+    //------------------------------------------------------------------------
+    // Constructor, grace period in seconds
+    //------------------------------------------------------------------------
+    HandlePool(size_t maxHandles, uint32_t grace);
+
+    //------------------------------------------------------------------------
+    // Destructor, the handles still in the pool are dropped without a close
+    // as the post master is already gone when the factory goes away
+    //------------------------------------------------------------------------
+    ~HandlePool();
+
+    //------------------------------------------------------------------------
+    // Key of an open, the URL and the flags
+    //------------------------------------------------------------------------
+    static std::string Key(const std::string& url, XrdCl::OpenFlags::Flags flags);
+
+    //------------------------------------------------------------------------
+    // An open file for the key, 0 if there is none, and the endpoint it was
+    // opened through
+    //------------------------------------------------------------------------
+    std::unique_ptr<XrdCl::File> Take(const std::string& key, ProxyEndpoint*& endpoint);
+
+    //------------------------------------------------------------------------
+    // Keep the open file for the key, with the endpoint it was opened
+    // through, 0 for a direct access
+    //------------------------------------------------------------------------
+    void Put(const std::string& key, std::unique_ptr<XrdCl::File> file,
+             ProxyEndpoint* endpoint);
+
+  private:
+    class Sweeper;
+    typedef std::chrono::steady_clock Clock;
+
+    struct Handle {
+        std::string key;
+        std::unique_ptr<XrdCl::File> file;
+        ProxyEndpoint* endpoint;
+        Clock::time_point expires;
+    };
+    typedef std::list<Handle> HandleList;
+
+    //------------------------------------------------------------------------
+    // The handles, shared with the sweeper task that may outlive the pool
+    //------------------------------------------------------------------------
+    struct State {
+        State() : stopped(false) {}
+        std::mutex mtx;
+        HandleList lru; //< most recently closed first
+        std::unordered_multimap<std::string, HandleList::iterator> index;
+        bool stopped;
+
+        // move the expired and surplus handles to the list, lock held
+        void Evict(size_t maxHandles, Clock::time_point now, HandleList& evicted);
+    };
+
+    static void Close(HandleList& handles);
+
+    size_t maxHandles;
+    Clock::duration grace;
+    std::shared_ptr<State> state;
+    std::atomic<bool> sweeperStarted;
+};
+}
+
+#endif // __XRDPROXYPREFIX_HANDLEPOOL_HH___
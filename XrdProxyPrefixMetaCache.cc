@@ -0,0 +1,232 @@
+/********************************************************************************
+ *    Copyright (C) 2014 GSI Helmholtzzentrum fuer Schwerionenforschung GmbH *
+ *                                                                              *
+ *              This software is distributed under the terms of the *
+ *         GNU Lesser General Public Licence version 3 (LGPL) version 3, *
+ *                  copied verbatim in the file "LICENSE" *
+ ********************************************************************************/
+
+#include "XrdProxyPrefixMetaCache.hh"
+#include "XProtocol/XProtocol.hh"
+#include <algorithm>
+#include <functional>
+
+using namespace XrdCl;
+
+namespace {
+std::string entryKey(ProxyPrefix::MetadataCache::Kind kind, const std::string& key) {
+    std::string k;
+    k.reserve(key.size() + 1);
+    k.append(1, char('0' + kind)).append(key);
+    return k;
+}
+
+//----------------------------------------------------------------------------
+// A fresh copy of the cached object for the user, who owns the response
+//----------------------------------------------------------------------------
+AnyObject* copyObject(ProxyPrefix::MetadataCache::Kind kind, const void* object) {
+    AnyObject* obj = new AnyObject();
+    switch (kind) {
+    case ProxyPrefix::MetadataCache::Stat:
+        obj->Set(new StatInfo(*static_cast<const StatInfo*>(object)));
+        break;
+    case ProxyPrefix::MetadataCache::StatVFS:
+        obj->Set(new StatInfoVFS(*static_cast<const StatInfoVFS*>(object)));
+        break;
+    case ProxyPrefix::MetadataCache::Locate:
+        obj->Set(new LocationInfo(*static_cast<const LocationInfo*>(object)));
+        break;
+    }
+    return obj;
+}
+
+template <typename T> std::shared_ptr<void> keepObject(AnyObject* response) {
+    T* object = 0;
+    response->Get(object);
+    if (!object)
+        return std::shared_ptr<void>();
+    return std::make_shared<T>(*object);
+}
+}
+
+namespace ProxyPrefix {
+//----------------------------------------------------------------------------
+// Stores the response and passes it on to the user
+//----------------------------------------------------------------------------
+class MetadataCache::StoreHandler : public XrdCl::ResponseHandler {
+  private:
+    MetadataCache* cache;
+    Kind kind;
+    std::string key;
+    uint64_t generation;
+    XrdCl::ResponseHandler* handler;
+
+  public:
+    StoreHandler(MetadataCache* c, Kind k, const std::string& ky, uint64_t g,
+                 XrdCl::ResponseHandler* h)
+      : cache(c), kind(k), key(ky), generation(g), handler(h) {}
+
+    virtual void HandleResponseWithHosts(XRootDStatus* status, AnyObject* response,
+                                         HostList* hostList) {
+        cache->Store(kind, key, generation, *status, response);
+        handler->HandleResponseWithHosts(status, response, hostList);
+        delete this;
+    }
+};
+
+//----------------------------------------------------------------------------
+// Invalidates the modified paths once more when the request completed
+//----------------------------------------------------------------------------
+class MetadataCache::UpdateHandler : public XrdCl::ResponseHandler {
+  private:
+    MetadataCache* cache;
+    std::vector<std::string> keys;
+    XrdCl::ResponseHandler* handler;
+
+  public:
+    UpdateHandler(MetadataCache* c, const std::vector<std::string>& k, XrdCl::ResponseHandler* h)
+      : cache(c), keys(k), handler(h) {}
+
+    virtual void HandleResponseWithHosts(XRootDStatus* status, AnyObject* response,
+                                         HostList* hostList) {
+        for (auto& key : keys)
+            cache->Invalidate(key);
+        handler->HandleResponseWithHosts(status, response, hostList);
+        delete this;
+    }
+};
+
+MetadataCache::MetadataCache(size_t maxEntries, uint32_t positive, uint32_t negative)
+  : shardSize(std::max<size_t>((maxEntries + shardCount - 1) / shardCount, 1)),
+    positiveTTL(std::chrono::seconds(positive)), negativeTTL(std::chrono::seconds(negative)),
+    generation(0) {}
+
+MetadataCache::Shard& MetadataCache::GetShard(const std::string& key) {
+    return shards[std::hash<std::string>()(key) % shardCount];
+}
+
+bool MetadataCache::Answer(Kind kind, const std::string& key, XrdCl::ResponseHandler* handler) {
+    std::string k = entryKey(kind, key);
+    Shard& shard = GetShard(k);
+    XRootDStatus* status = 0;
+    AnyObject* obj = 0;
+    {
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        auto it = shard.entries.find(k);
+        if (it == shard.entries.end())
+            return false;
+        Entry& entry = it->second;
+        if (entry.expires <= Clock::now()) {
+            shard.lru.erase(entry.lru);
+            shard.entries.erase(it);
+            return false;
+        }
+        shard.lru.splice(shard.lru.begin(), shard.lru, entry.lru);
+        status = new XRootDStatus(entry.status);
+        if (entry.object)
+            obj = copyObject(kind, entry.object.get());
+    }
+    handler->HandleResponseWithHosts(status, obj, new HostList());
+    return true;
+}
+
+XrdCl::ResponseHandler* MetadataCache::Wrap(Kind kind, const std::string& key,
+                                            XrdCl::ResponseHandler* handler) {
+    return new StoreHandler(this, kind, key, generation.load(), handler);
+}
+
+XrdCl::ResponseHandler* MetadataCache::WrapUpdate(const std::vector<std::string>& keys,
+                                                  XrdCl::ResponseHandler* handler) {
+    return new UpdateHandler(this, keys, handler);
+}
+
+void MetadataCache::Store(Kind kind, const std::string& key, uint64_t gen,
+                          const XrdCl::XRootDStatus& status, XrdCl::AnyObject* response) {
+    std::shared_ptr<void> object;
+    Clock::duration ttl;
+    if (status.IsOK() && response) {
+        switch (kind) {
+        case Stat:
+            object = keepObject<StatInfo>(response);
+            break;
+        case StatVFS:
+            object = keepObject<StatInfoVFS>(response);
+            break;
+        case Locate:
+            object = keepObject<LocationInfo>(response);
+            break;
+        }
+        if (!object)
+            return;
+        ttl = positiveTTL;
+    } else if (status.code == errErrorResponse && status.errNo == kXR_NotFound) {
+        ttl = negativeTTL;
+    } else {
+        return;
+    }
+    if (ttl == Clock::duration::zero())
+        return;
+
+    std::string k = entryKey(kind, key);
+    Shard& shard = GetShard(k);
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    if (gen != generation.load())
+        return;
+    auto it = shard.entries.find(k);
+    if (it == shard.entries.end()) {
+        shard.lru.push_front(k);
+        it = shard.entries.emplace(k, Entry()).first;
+        it->second.lru = shard.lru.begin();
+    } else {
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lru);
+    }
+    Entry& entry = it->second;
+    entry.expires = Clock::now() + ttl;
+    entry.object = object;
+    entry.status = status;
+    while (shard.entries.size() > shardSize) {
+        shard.entries.erase(shard.lru.back());
+        shard.lru.pop_back();
+    }
+}
+
+void MetadataCache::Invalidate(const std::string& key) {
+    ++generation;
+    size_t slash = key.rfind('/');
+    for (int kind = Stat; kind <= Locate; ++kind) {
+        Erase(entryKey(Kind(kind), key));
+        if (slash != std::string::npos)
+            Erase(entryKey(Kind(kind), key.substr(0, slash)));
+    }
+}
+
+void MetadataCache::Erase(const std::string& k) {
+    Shard& shard = GetShard(k);
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    auto it = shard.entries.find(k);
+    if (it == shard.entries.end())
+        return;
+    shard.lru.erase(it->second.lru);
+    shard.entries.erase(it);
+}
+
+MetadataRequest::MetadataRequest(MetadataCache* cache, MetadataCache::Kind kind,
+                                 const std::string& key, XrdCl::ResponseHandler* h)
+  : handler(h), wrapper(0), answered(false) {
+    if (!cache)
+        return;
+    answered = cache->Answer(kind, key, handler);
+    if (!answered)
+        wrapper = cache->Wrap(kind, key, handler);
+}
+
+MetadataRequest::MetadataRequest(MetadataCache* cache, const std::vector<std::string>& keys,
+                                 XrdCl::ResponseHandler* h)
+  : handler(h), wrapper(0), answered(false) {
+    if (!cache)
+        return;
+    for (auto& key : keys)
+        cache->Invalidate(key);
+    wrapper = cache->WrapUpdate(keys, handler);
+}
+}
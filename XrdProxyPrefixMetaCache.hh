@@ -0,0 +1,133 @@
+/********************************************************************************
+ *    Copyright (C) 2014 GSI Helmholtzzentrum fuer Schwerionenforschung GmbH *
+ *                                                                              *
+ *              This software is distributed under the terms of the *
+ *         GNU Lesser General Public Licence version 3 (LGPL) version 3, *
+ *                  copied verbatim in the file "LICENSE" *
+ ********************************************************************************/
+#ifndef __XRDPROXYPREFIX_METACACHE_HH___
+#define __XRDPROXYPREFIX_METACACHE_HH___
+#include "XrdCl/XrdClXRootDResponses.hh"
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ProxyPrefix {
+//----------------------------------------------------------------------------
+// Results of Stat, StatVFS and Locate shared by all the file systems of the
+// process, keyed by the target path. Answers are kept for the positive TTL,
+// "not found" errors for the negative TTL. The keys are spread over shards
+// with a lock and an LRU list each.
+//----------------------------------------------------------------------------
+class MetadataCache {
+  public:
+    enum Kind { Stat, StatVFS, Locate };
+
+    //------------------------------------------------------------------------
+    // Constructor, TTLs in seconds
+    //------------------------------------------------------------------------
+    MetadataCache(size_t maxEntries, uint32_t positiveTTL, uint32_t negativeTTL);
+
+    //------------------------------------------------------------------------
+    // Call the handler with the cached answer, false if there is none
+    //------------------------------------------------------------------------
+    bool Answer(Kind kind, const std::string& key, XrdCl::ResponseHandler* handler);
+
+    //------------------------------------------------------------------------
+    // Wrap the handler of a request so its response is stored
+    //------------------------------------------------------------------------
+    XrdCl::ResponseHandler* Wrap(Kind kind, const std::string& key,
+                                 XrdCl::ResponseHandler* handler);
+
+    //------------------------------------------------------------------------
+    // Wrap the handler of a modifying request, the keys are invalidated
+    // again once it completed
+    //------------------------------------------------------------------------
+    XrdCl::ResponseHandler* WrapUpdate(const std::vector<std::string>& keys,
+                                       XrdCl::ResponseHandler* handler);
+
+    //------------------------------------------------------------------------
+    // Forget everything about the path and its parent directory, keys are
+    // expected without trailing slashes
+    //------------------------------------------------------------------------
+    void Invalidate(const std::string& key);
+
+  private:
+    class StoreHandler;
+    class UpdateHandler;
+    typedef std::chrono::steady_clock Clock;
+
+    struct Entry {
+        Clock::time_point expires;
+        std::shared_ptr<void> object; //< 0 for a cached error
+        XrdCl::XRootDStatus status;
+        std::list<std::string>::iterator lru;
+    };
+
+    struct Shard {
+        std::mutex mtx;
+        std::unordered_map<std::string, Entry> entries;
+        std::list<std::string> lru;
+    };
+
+    static const size_t shardCount = 16;
+
+    Shard& GetShard(const std::string& key);
+    void Store(Kind kind, const std::string& key, uint64_t gen,
+               const XrdCl::XRootDStatus& status, XrdCl::AnyObject* response);
+    void Erase(const std::string& key);
+
+    size_t shardSize;
+    Clock::duration positiveTTL;
+    Clock::duration negativeTTL;
+    // bumped by every invalidation, responses to older requests are stale
+    std::atomic<uint64_t> generation;
+    Shard shards[shardCount];
+};
+
+//----------------------------------------------------------------------------
+// A request to a file system going through the cache, which may be 0. The
+// request is sent with Handler() and the status of the send passed through
+// Sent(), a handler that was not handed over is deleted with the object.
+//----------------------------------------------------------------------------
+class MetadataRequest {
+  public:
+    //------------------------------------------------------------------------
+    // A lookup, Answered() tells whether it was served from the cache
+    //------------------------------------------------------------------------
+    MetadataRequest(MetadataCache* cache, MetadataCache::Kind kind, const std::string& key,
+                    XrdCl::ResponseHandler* handler);
+
+    //------------------------------------------------------------------------
+    // A request modifying the given paths, they are invalidated right away
+    //------------------------------------------------------------------------
+    MetadataRequest(MetadataCache* cache, const std::vector<std::string>& keys,
+                    XrdCl::ResponseHandler* handler);
+
+    ~MetadataRequest() { delete wrapper; }
+
+    bool Answered() const { return answered; }
+    XrdCl::ResponseHandler* Handler() const { return wrapper ? wrapper : handler; }
+
+    XrdCl::XRootDStatus Sent(const XrdCl::XRootDStatus& status) {
+        if (status.IsOK())
+            wrapper = 0;
+        return status;
+    }
+
+  private:
+    MetadataRequest(const MetadataRequest&);
+    MetadataRequest& operator=(const MetadataRequest&);
+
+    XrdCl::ResponseHandler* handler;
+    XrdCl::ResponseHandler* wrapper;
+    bool answered;
+};
+}
+
+#endif // __XRDPROXYPREFIX_METACACHE_HH___
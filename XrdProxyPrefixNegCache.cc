@@ -0,0 +1,166 @@
+/********************************************************************************
+ *    Copyright (C) 2014 GSI Helmholtzzentrum fuer Schwerionenforschung GmbH *
+ *                                                                              *
+ *              This software is distributed under the terms of the *
+ *         GNU Lesser General Public Licence version 3 (LGPL) version 3, *
+ *                  copied verbatim in the file "LICENSE" *
+ ********************************************************************************/
+
+#include "XrdProxyPrefixNegCache.hh"
+#include "XProtocol/XProtocol.hh"
+#include <algorithm>
+#include <functional>
+
+using namespace XrdCl;
+
+namespace {
+//----------------------------------------------------------------------------
+// Second hash for the double hashing of the Bloom filter, odd so every
+// probe moves
+//----------------------------------------------------------------------------
+uint64_t mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h | 1;
+}
+}
+
+namespace ProxyPrefix {
+const int NegativeCache::bucketCount;
+const int NegativeCache::hashCount;
+
+//----------------------------------------------------------------------------
+// Remembers a kXR_NotFound answer and passes it on to the user
+//----------------------------------------------------------------------------
+class NegativeCache::MissHandler : public XrdCl::ResponseHandler {
+  private:
+    NegativeCache* cache;
+    std::string key;
+    XrdCl::ResponseHandler* handler;
+
+  public:
+    MissHandler(NegativeCache* c, const std::string& k, XrdCl::ResponseHandler* h)
+      : cache(c), key(k), handler(h) {}
+
+    virtual void HandleResponseWithHosts(XRootDStatus* status, AnyObject* response,
+                                         HostList* hostList) {
+        if (status->code == errErrorResponse && status->errNo == kXR_NotFound)
+            cache->Insert(key);
+        handler->HandleResponseWithHosts(status, response, hostList);
+        delete this;
+    }
+};
+
+NegativeCache::NegativeCache(size_t entries, uint32_t seconds)
+  : maxEntries(std::max<size_t>(entries, 1)), ttl(std::chrono::seconds(seconds)),
+    bucketWidth(std::max<Clock::duration>((ttl + Clock::duration(bucketCount - 1)) / bucketCount,
+                                          Clock::duration(1))),
+    bitCount((maxEntries * 8 + 63) / 64 * 64) {
+    for (auto& bucket : buckets) {
+        bucket.epoch = -1;
+        bucket.bits.reset(new std::atomic<uint64_t>[bitCount / 64]);
+        for (uint64_t i = 0; i < bitCount / 64; ++i)
+            bucket.bits[i] = 0;
+    }
+}
+
+std::string NegativeCache::Key(const std::string& host, const std::string& path) {
+    size_t begin = path.find_first_not_of('/');
+    size_t end = path.find_last_not_of('/');
+    if (begin == std::string::npos)
+        return host;
+    std::string key;
+    key.reserve(host.size() + 1 + end + 1 - begin);
+    key.append(host).append(1, '/').append(path, begin, end + 1 - begin);
+    return key;
+}
+
+int64_t NegativeCache::Epoch(Clock::time_point now) const {
+    return now.time_since_epoch() / bucketWidth;
+}
+
+bool NegativeCache::MayContain(size_t hash, int64_t epoch) const {
+    uint64_t step = mix(hash);
+    for (auto& bucket : buckets) {
+        int64_t e = bucket.epoch.load(std::memory_order_acquire);
+        if (e < 0 || e + bucketCount < epoch || e > epoch)
+            continue;
+        uint64_t h = hash;
+        int i = 0;
+        for (; i < hashCount; ++i, h += step) {
+            uint64_t bit = h % bitCount;
+            if (!(bucket.bits[bit / 64].load(std::memory_order_relaxed) & (1ULL << bit % 64)))
+                break;
+        }
+        if (i == hashCount)
+            return true;
+    }
+    return false;
+}
+
+bool NegativeCache::Answer(const std::string& key, XrdCl::ResponseHandler* handler) {
+    Clock::time_point now = Clock::now();
+    if (!MayContain(std::hash<std::string>()(key), Epoch(now)))
+        return false;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = misses.find(key);
+        if (it == misses.end() || it->second <= now)
+            return false;
+    }
+    handler->HandleResponseWithHosts(
+      new XRootDStatus(stError, errErrorResponse, kXR_NotFound, "No such file or directory"), 0,
+      new HostList());
+    return true;
+}
+
+XrdCl::ResponseHandler* NegativeCache::Wrap(const std::string& key,
+                                            XrdCl::ResponseHandler* handler) {
+    return new MissHandler(this, key, handler);
+}
+
+void NegativeCache::Insert(const std::string& key) {
+    if (ttl == Clock::duration::zero())
+        return;
+    Clock::time_point now = Clock::now();
+    std::lock_guard<std::mutex> lock(mtx);
+    // the queue may hold outdated entries of removed or renewed keys
+    while (!order.empty() && (order.front().second <= now || order.size() >= maxEntries)) {
+        auto it = misses.find(order.front().first);
+        if (it != misses.end() && it->second == order.front().second)
+            misses.erase(it);
+        order.pop_front();
+    }
+    Clock::time_point expires = now + ttl;
+    misses[key] = expires;
+    order.push_back(std::make_pair(key, expires));
+
+    int64_t epoch = Epoch(now);
+    Bucket& bucket = buckets[epoch % (bucketCount + 1)];
+    if (bucket.epoch.load() != epoch) {
+        for (uint64_t i = 0; i < bitCount / 64; ++i)
+            bucket.bits[i].store(0, std::memory_order_relaxed);
+        bucket.epoch.store(epoch, std::memory_order_release);
+    }
+    size_t hash = std::hash<std::string>()(key);
+    uint64_t step = mix(hash);
+    uint64_t h = hash;
+    for (int i = 0; i < hashCount; ++i, h += step) {
+        uint64_t bit = h % bitCount;
+        bucket.bits[bit / 64].fetch_or(1ULL << bit % 64, std::memory_order_relaxed);
+    }
+}
+
+void NegativeCache::Remove(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (misses.empty())
+        return;
+    misses.erase(key);
+    for (size_t slash = key.rfind('/'); slash != std::string::npos && slash > 0;
+         slash = key.rfind('/', slash - 1))
+        misses.erase(key.substr(0, slash));
+}
+}
@@ -0,0 +1,122 @@
+/********************************************************************************
+ *    Copyright (C) 2014 GSI Helmholtzzentrum fuer Schwerionenforschung GmbH *
+ *                                                                              *
+ *              This software is distributed under the terms of the *
+ *         GNU Lesser General Public Licence version 3 (LGPL) version 3, *
+ *                  copied verbatim in the file "LICENSE" *
+ ********************************************************************************/
+#ifndef __XRDPROXYPREFIX_NEGCACHE_HH___
+#define __XRDPROXYPREFIX_NEGCACHE_HH___
+#include "XrdCl/XrdClXRootDResponses.hh"
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace ProxyPrefix {
+//----------------------------------------------------------------------------
+// Paths recently found missing by an open or a stat, answered with
+// kXR_NotFound until the TTL ran out. A Bloom filter per time bucket lets
+// lookups of existing paths pass without taking the lock, the exact set
+// of recent misses has the final word.
+//----------------------------------------------------------------------------
+class NegativeCache {
+  public:
+    //------------------------------------------------------------------------
+    // Constructor, TTL in seconds
+    //------------------------------------------------------------------------
+    NegativeCache(size_t maxEntries, uint32_t ttl);
+
+    //------------------------------------------------------------------------
+    // Key of a path: target host and the path without leading and trailing
+    // slashes
+    //------------------------------------------------------------------------
+    static std::string Key(const std::string& host, const std::string& path);
+
+    //------------------------------------------------------------------------
+    // Call the handler with kXR_NotFound if the path is known to be missing
+    //------------------------------------------------------------------------
+    bool Answer(const std::string& key, XrdCl::ResponseHandler* handler);
+
+    //------------------------------------------------------------------------
+    // Wrap the handler of a lookup so a kXR_NotFound answer is remembered
+    //------------------------------------------------------------------------
+    XrdCl::ResponseHandler* Wrap(const std::string& key, XrdCl::ResponseHandler* handler);
+
+    //------------------------------------------------------------------------
+    // The path and its parents are about to be created
+    //------------------------------------------------------------------------
+    void Remove(const std::string& key);
+
+  private:
+    class MissHandler;
+    typedef std::chrono::steady_clock Clock;
+
+    //------------------------------------------------------------------------
+    // Bloom filter of the misses inserted during one epoch
+    //------------------------------------------------------------------------
+    struct Bucket {
+        std::atomic<int64_t> epoch;
+        std::unique_ptr<std::atomic<uint64_t>[]> bits;
+    };
+
+    static const int bucketCount = 4;
+    static const int hashCount = 5;
+
+    int64_t Epoch(Clock::time_point now) const;
+    bool MayContain(size_t hash, int64_t epoch) const;
+    void Insert(const std::string& key);
+
+    size_t maxEntries;
+    Clock::duration ttl;
+    Clock::duration bucketWidth;
+    uint64_t bitCount;
+    // one more bucket than the TTL needs, the oldest is reused next
+    Bucket buckets[bucketCount + 1];
+
+    std::mutex mtx;
+    std::unordered_map<std::string, Clock::time_point> misses;
+    std::deque<std::pair<std::string, Clock::time_point> > order; //< by expiry
+};
+
+//----------------------------------------------------------------------------
+// A lookup going through the negative cache, which may be 0. Used like
+// MetadataRequest: send with Handler(), pass the status through Sent().
+//----------------------------------------------------------------------------
+class NegativeLookup {
+  public:
+    NegativeLookup(NegativeCache* cache, const std::string& key, XrdCl::ResponseHandler* h)
+      : handler(h), wrapper(0), answered(false) {
+        if (!cache)
+            return;
+        answered = cache->Answer(key, handler);
+        if (!answered)
+            wrapper = cache->Wrap(key, handler);
+    }
+
+    ~NegativeLookup() { delete wrapper; }
+
+    bool Answered() const { return answered; }
+    XrdCl::ResponseHandler* Handler() const { return wrapper ? wrapper : handler; }
+
+    XrdCl::XRootDStatus Sent(const XrdCl::XRootDStatus& status) {
+        if (status.IsOK())
+            wrapper = 0;
+        return status;
+    }
+
+  private:
+    NegativeLookup(const NegativeLookup&);
+    NegativeLookup& operator=(const NegativeLookup&);
+
+    XrdCl::ResponseHandler* handler;
+    XrdCl::ResponseHandler* wrapper;
+    bool answered;
+};
+}
+
+#endif // __XRDPROXYPREFIX_NEGCACHE_HH___
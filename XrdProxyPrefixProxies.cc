@@ -0,0 +1,316 @@
+/********************************************************************************
+ *    Copyright (C) 2014 GSI Helmholtzzentrum fuer Schwerionenforschung GmbH *
+ *                                                                              *
+ *              This software is distributed under the terms of the *
+ *         GNU Lesser General Public Licence version 3 (LGPL) version 3, *
+ *                  copied verbatim in the file "LICENSE" *
+ ********************************************************************************/
+
+#include "XrdProxyPrefixProxies.hh"
+#include "XrdCl/XrdClDefaultEnv.hh"
+#include "XrdCl/XrdClFileSystem.hh"
+#include "XrdCl/XrdClLog.hh"
+#include "XrdCl/XrdClPostMaster.hh"
+#include "XrdCl/XrdClTaskManager.hh"
+#include "XrdCl/XrdClURL.hh"
+#include <algorithm>
+#include <ctime>
+#include <random>
+
+using namespace XrdCl;
+
+namespace {
+//----------------------------------------------------------------------------
+// FNV-1a with a final avalanche, similar keys end up far apart on the ring
+//----------------------------------------------------------------------------
+uint64_t ringHash(const std::string& s) {
+    uint64_t h = 14695981039346656037ULL;
+    for (unsigned char c : s) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+//----------------------------------------------------------------------------
+// host[:port] of a proxyPrefix entry
+//----------------------------------------------------------------------------
+std::string proxyHost(const std::string& entry) {
+    size_t start = entry.find("://");
+    start = start == std::string::npos ? 0 : start + 3;
+    size_t end = entry.find('/', start);
+    return entry.substr(start, end == std::string::npos ? end : end - start);
+}
+}
+
+namespace ProxyPrefix {
+const double ProxyEndpoint::alpha = 0.2;
+uint32_t ProxyEndpoint::fallThreshold = 2;
+uint32_t ProxyEndpoint::riseThreshold = 2;
+
+TrackedHandler::TrackedHandler(ProxyEndpoint* e, XrdCl::ResponseHandler* h)
+  : endpoint(e), handler(h), start(std::chrono::steady_clock::now()) {}
+
+void TrackedHandler::HandleResponseWithHosts(XRootDStatus* status, AnyObject* response,
+                                             HostList* hostList) {
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    endpoint->End(elapsed.count());
+    handler->HandleResponseWithHosts(status, response, hostList);
+    delete this;
+}
+
+void TrackedHandler::Cancel() {
+    endpoint->Cancel();
+    delete this;
+}
+
+ProxyEndpoint::ProxyEndpoint(const std::string& entry)
+  : host(proxyHost(entry)), prefix("://" + host + "//"),
+    hostId(XrdCl::URL("root" + prefix).GetHostId()), inFlight(0), latency(0), up(true),
+    streak(0) {}
+
+void ProxyEndpoint::setHysteresis(uint32_t fall, uint32_t rise) {
+    fallThreshold = std::max<uint32_t>(fall, 1);
+    riseThreshold = std::max<uint32_t>(rise, 1);
+}
+
+//----------------------------------------------------------------------------
+// streak counts the consecutive results contradicting the current state
+//----------------------------------------------------------------------------
+void ProxyEndpoint::ReportHealth(bool ok) {
+    std::lock_guard<std::mutex> lock(healthMtx);
+    if (ok == up.load()) {
+        streak = 0;
+        return;
+    }
+    if (++streak < (ok ? riseThreshold : fallThreshold))
+        return;
+    streak = 0;
+    up = ok;
+    XrdCl::Log* log = XrdCl::DefaultEnv::GetLog();
+    if (ok)
+        log->Info(1, "XrdProxyPrefix: proxy %s is up again", host.c_str());
+    else
+        log->Warning(1, "XrdProxyPrefix: proxy %s is down", host.c_str());
+}
+
+TrackedHandler* ProxyEndpoint::Track(XrdCl::ResponseHandler* handler) {
+    Begin();
+    return new TrackedHandler(this, handler);
+}
+
+void ProxyEndpoint::End(double seconds) {
+    --inFlight;
+    double old = latency.load();
+    double now;
+    do {
+        now = old ? (1 - alpha) * old + alpha * seconds : seconds;
+    } while (!latency.compare_exchange_weak(old, now));
+}
+
+ProxyList::ProxyList(const std::string& config, Routing r, uint32_t virtualNodes, uint32_t lf)
+  : routing(r), loadFactor(std::max<uint32_t>(lf, 100)), healthInterval(0),
+    healthTimeout(0), healthCheckStarted(false),
+    stopped(std::make_shared<std::atomic<bool> >(false)) {
+    size_t pos = 0;
+    while (pos < config.size()) {
+        size_t start = config.find_first_not_of(", \t", pos);
+        if (start == std::string::npos)
+            break;
+        pos = config.find_first_of(", \t", start);
+        endpoints.emplace_back(new ProxyEndpoint(config.substr(start, pos - start)));
+    }
+    if (endpoints.empty()) {
+        XrdCl::Log* log = XrdCl::DefaultEnv::GetLog();
+        log->Error(1, "XrdProxyPrefix: no proxyPrefix configured");
+        endpoints.emplace_back(new ProxyEndpoint("UNSET"));
+    }
+    if (routing != Hashed)
+        return;
+    virtualNodes = std::max<uint32_t>(virtualNodes, 1);
+    for (auto& endpoint : endpoints)
+        for (uint32_t i = 0; i < virtualNodes; ++i)
+            ring.emplace_back(ringHash(endpoint->GetHost() + "#" + std::to_string(i)),
+                              endpoint.get());
+    std::sort(ring.begin(), ring.end());
+}
+
+//----------------------------------------------------------------------------
+// Pings the proxies from the task manager thread. The task, the pings and
+// their handlers only share the endpoints, so they can outlive the list;
+// the task ends at its next run once the list is gone.
+//----------------------------------------------------------------------------
+class ProxyList::HealthCheck : public XrdCl::Task {
+  private:
+    struct Probe {
+        std::shared_ptr<ProxyEndpoint> endpoint;
+        std::shared_ptr<XrdCl::FileSystem> fs;
+        std::shared_ptr<std::atomic<bool> > busy;
+    };
+
+    class PingHandler : public XrdCl::ResponseHandler {
+      private:
+        Probe probe;
+
+      public:
+        PingHandler(const Probe& p) : probe(p) {}
+
+        virtual void HandleResponseWithHosts(XRootDStatus* status, AnyObject* response,
+                                             HostList* hostList) {
+            probe.endpoint->ReportHealth(status->IsOK());
+            *probe.busy = false;
+            delete status;
+            delete response;
+            delete hostList;
+            delete this;
+        }
+    };
+
+    std::vector<Probe> probes;
+    std::shared_ptr<std::atomic<bool> > stopped;
+    uint32_t interval;
+    uint16_t timeout;
+
+  public:
+    HealthCheck(const std::vector<std::shared_ptr<ProxyEndpoint> >& endpoints,
+                const std::shared_ptr<std::atomic<bool> >& s, uint32_t i, uint16_t t)
+      : stopped(s), interval(std::max<uint32_t>(i, 1)), timeout(t) {
+        SetName("XrdProxyPrefix health check");
+        for (auto& endpoint : endpoints) {
+            Probe probe;
+            probe.endpoint = endpoint;
+            // no plug-ins, the ping must go to the proxy itself
+            probe.fs = std::make_shared<XrdCl::FileSystem>(
+              XrdCl::URL("root" + endpoint->GetPrefix()), false);
+            probe.busy = std::make_shared<std::atomic<bool> >(false);
+            probes.push_back(probe);
+        }
+    }
+
+    virtual time_t Run(time_t now) {
+        if (*stopped)
+            return 0;
+        for (auto& probe : probes) {
+            // a ping still waiting for its answer counts when it finishes
+            if (probe.busy->exchange(true))
+                continue;
+            PingHandler* handler = new PingHandler(probe);
+            XRootDStatus st = probe.fs->Ping(handler, timeout);
+            if (!st.IsOK()) {
+                delete handler;
+                *probe.busy = false;
+                probe.endpoint->ReportHealth(false);
+            }
+        }
+        return now + interval;
+    }
+};
+
+ProxyList::~ProxyList() { *stopped = true; }
+
+bool ProxyList::Contains(const std::string& hostId) const {
+    for (auto& endpoint : endpoints)
+        if (!hostId.empty() && endpoint->GetHostId() == hostId)
+            return true;
+    return false;
+}
+
+void ProxyList::SetHealthCheck(uint32_t interval, uint16_t timeout) {
+    healthInterval = interval;
+    healthTimeout = timeout;
+}
+
+void ProxyList::StartHealthCheck() {
+    if (!healthInterval || endpoints.size() == 1 || healthCheckStarted.exchange(true))
+        return;
+    XrdCl::PostMaster* postMaster = XrdCl::DefaultEnv::GetPostMaster();
+    if (!postMaster)
+        return;
+    postMaster->GetTaskManager()->RegisterTask(
+      new HealthCheck(endpoints, stopped, healthInterval, healthTimeout), time(0), true);
+}
+
+ProxyEndpoint* ProxyList::Select(const std::string& key, const ProxyEndpoint* exclude) const {
+    if (endpoints.size() == 1)
+        return endpoints[0].get();
+    bool any = false;
+    for (auto& endpoint : endpoints)
+        any = any || Usable(endpoint.get(), exclude, false);
+    return routing == Hashed ? SelectHashed(key, exclude, !any) : SelectBalanced(exclude, !any);
+}
+
+bool ProxyList::Usable(const ProxyEndpoint* endpoint, const ProxyEndpoint* exclude,
+                       bool all) const {
+    return all || (endpoint != exclude && endpoint->IsUp());
+}
+
+ProxyEndpoint* ProxyList::SelectBalanced(const ProxyEndpoint* exclude, bool all) const {
+    ProxyEndpoint* usable[2] = { 0, 0 };
+    size_t count = 0;
+    for (auto& endpoint : endpoints)
+        if (Usable(endpoint.get(), exclude, all) && count++ < 2)
+            usable[count - 1] = endpoint.get();
+    static thread_local std::minstd_rand rng(std::random_device{}());
+    if (count == 1)
+        return usable[0];
+    if (count == 2) {
+        // random order, ties must not always go to the same proxy
+        if (rng() & 1)
+            std::swap(usable[0], usable[1]);
+        return usable[0]->GetScore() <= usable[1]->GetScore() ? usable[0] : usable[1];
+    }
+
+    size_t a = rng() % count;
+    size_t b = rng() % (count - 1);
+    if (b >= a)
+        ++b;
+    ProxyEndpoint* first = 0;
+    ProxyEndpoint* second = 0;
+    size_t i = 0;
+    for (auto& endpoint : endpoints) {
+        if (!Usable(endpoint.get(), exclude, all))
+            continue;
+        if (i == a)
+            first = endpoint.get();
+        if (i == b)
+            second = endpoint.get();
+        ++i;
+    }
+    return first->GetScore() <= second->GetScore() ? first : second;
+}
+
+//----------------------------------------------------------------------------
+// Consistent hashing with bounded loads: the first proxy clockwise from the
+// key that is not above loadFactor percent of the average in-flight count
+//----------------------------------------------------------------------------
+ProxyEndpoint* ProxyList::SelectHashed(const std::string& key, const ProxyEndpoint* exclude,
+                                       bool all) const {
+    uint64_t total = 0;
+    uint64_t count = 0;
+    for (auto& endpoint : endpoints) {
+        total += endpoint->GetInFlight();
+        count += Usable(endpoint.get(), exclude, all);
+    }
+    uint64_t bound = ((total + 1) * loadFactor + count * 100 - 1) / (count * 100);
+
+    auto it = std::lower_bound(ring.begin(), ring.end(),
+                               std::make_pair(ringHash(key), (ProxyEndpoint*)0));
+    ProxyEndpoint* fallback = 0;
+    for (size_t i = 0; i < ring.size(); ++i, ++it) {
+        if (it == ring.end())
+            it = ring.begin();
+        if (!Usable(it->second, exclude, all))
+            continue;
+        if (it->second->GetInFlight() < bound)
+            return it->second;
+        if (!fallback)
+            fallback = it->second;
+    }
+    return fallback;
+}
+}
@@ -0,0 +1,176 @@
+/********************************************************************************
+ *    Copyright (C) 2014 GSI Helmholtzzentrum fuer Schwerionenforschung GmbH *
+ *                                                                              *
+ *              This software is distributed under the terms of the *
+ *         GNU Lesser General Public Licence version 3 (LGPL) version 3, *
+ *                  copied verbatim in the file "LICENSE" *
+ ********************************************************************************/
+#ifndef __XRDPROXYPREFIX_PROXIES_HH___
+#define __XRDPROXYPREFIX_PROXIES_HH___
+#include "XrdCl/XrdClXRootDResponses.hh"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ProxyPrefix {
+class ProxyEndpoint;
+
+//----------------------------------------------------------------------------
+// Accounts a request to an endpoint and forwards the response to the user
+// handler
+//----------------------------------------------------------------------------
+class TrackedHandler : public XrdCl::ResponseHandler {
+  public:
+    TrackedHandler(ProxyEndpoint* endpoint, XrdCl::ResponseHandler* handler);
+
+    virtual void HandleResponseWithHosts(XrdCl::XRootDStatus* status, XrdCl::AnyObject* response,
+                                         XrdCl::HostList* hostList);
+
+    //------------------------------------------------------------------------
+    // The request could not be sent, forget about it
+    //------------------------------------------------------------------------
+    void Cancel();
+
+  private:
+    ProxyEndpoint* endpoint;
+    XrdCl::ResponseHandler* handler;
+    std::chrono::steady_clock::time_point start;
+};
+
+//----------------------------------------------------------------------------
+// A single forward proxy together with its observed latency (EWMA) and the
+// number of requests currently in flight
+//----------------------------------------------------------------------------
+class ProxyEndpoint {
+  public:
+    //------------------------------------------------------------------------
+    // Constructor, takes a proxyPrefix entry: host[:port]. The protocol and
+    // slashes of the old ://host:port// form are ignored.
+    //------------------------------------------------------------------------
+    ProxyEndpoint(const std::string& entry);
+
+    //------------------------------------------------------------------------
+    // Failed probes before an endpoint is taken out of the rotation and
+    // successful ones before it is taken back
+    //------------------------------------------------------------------------
+    static void setHysteresis(uint32_t fall, uint32_t rise);
+
+    const std::string& GetHost() const { return host; }
+
+    //------------------------------------------------------------------------
+    // What goes between the protocol and the target URL, ://host:port//
+    //------------------------------------------------------------------------
+    const std::string& GetPrefix() const { return prefix; }
+    const std::string& GetHostId() const { return hostId; }
+    bool IsUp() const { return up.load(); }
+
+    //------------------------------------------------------------------------
+    // Account the outcome of a probe or of a request that could not reach
+    // the proxy
+    //------------------------------------------------------------------------
+    void ReportHealth(bool ok);
+    double GetLatency() const { return latency.load(); }
+    uint32_t GetInFlight() const { return inFlight.load(); }
+
+    //------------------------------------------------------------------------
+    // Lower is better: expected latency scaled by the queue in front of us
+    //------------------------------------------------------------------------
+    double GetScore() const { return (GetLatency() + 0.001) * (GetInFlight() + 1); }
+
+    //------------------------------------------------------------------------
+    // Wrap the handler of a request going through this endpoint
+    //------------------------------------------------------------------------
+    TrackedHandler* Track(XrdCl::ResponseHandler* handler);
+
+  private:
+    friend class TrackedHandler;
+    void Begin() { ++inFlight; }
+    void End(double seconds);
+    void Cancel() { --inFlight; }
+
+    static const double alpha;
+    static uint32_t fallThreshold;
+    static uint32_t riseThreshold;
+    std::string host;
+    std::string prefix;
+    std::string hostId;
+    std::atomic<uint32_t> inFlight;
+    std::atomic<double> latency;
+    std::atomic<bool> up;
+    std::mutex healthMtx;
+    uint32_t streak;
+};
+
+//----------------------------------------------------------------------------
+// The configured forward proxies
+//----------------------------------------------------------------------------
+class ProxyList {
+  public:
+    //------------------------------------------------------------------------
+    // How a new file or file system is routed to a proxy
+    //------------------------------------------------------------------------
+    enum Routing {
+        Balanced, //< the better of two randomly chosen proxies
+        Hashed    //< consistent hashing of the target, keeps proxy caches warm
+    };
+
+    //------------------------------------------------------------------------
+    // Constructor, takes a comma or blank separated list of proxy hosts.
+    // For hashed routing every proxy gets virtualNodes points on the ring
+    // and may carry loadFactor percent of the average load before keys
+    // spill over to the next proxy on the ring.
+    //------------------------------------------------------------------------
+    ProxyList(const std::string& config, Routing routing = Balanced, uint32_t virtualNodes = 160,
+              uint32_t loadFactor = 125);
+    ~ProxyList();
+
+    size_t Size() const { return endpoints.size(); }
+    ProxyEndpoint* Get(size_t i) const { return endpoints[i].get(); }
+
+    //------------------------------------------------------------------------
+    // Whether host:port is one of the proxies
+    //------------------------------------------------------------------------
+    bool Contains(const std::string& hostId) const;
+
+    //------------------------------------------------------------------------
+    // Pick an endpoint for the target identified by key (host and path).
+    // Endpoints that are down and the excluded one are skipped unless there
+    // is nothing else left.
+    //------------------------------------------------------------------------
+    ProxyEndpoint* Select(const std::string& key, const ProxyEndpoint* exclude = 0) const;
+
+    //------------------------------------------------------------------------
+    // Ping every proxy each interval seconds (0 disables the check), a ping
+    // not answered within timeout seconds counts as a failure
+    //------------------------------------------------------------------------
+    void SetHealthCheck(uint32_t interval, uint16_t timeout);
+
+    //------------------------------------------------------------------------
+    // Start the configured health check on the XrdCl task manager, must not
+    // be called before the client is initialized
+    //------------------------------------------------------------------------
+    void StartHealthCheck();
+
+  private:
+    class HealthCheck;
+    bool Usable(const ProxyEndpoint* endpoint, const ProxyEndpoint* exclude, bool all) const;
+    ProxyEndpoint* SelectBalanced(const ProxyEndpoint* exclude, bool all) const;
+    ProxyEndpoint* SelectHashed(const std::string& key, const ProxyEndpoint* exclude,
+                                bool all) const;
+
+    std::vector<std::shared_ptr<ProxyEndpoint> > endpoints;
+    Routing routing;
+    uint32_t loadFactor;
+    std::vector<std::pair<uint64_t, ProxyEndpoint*> > ring;
+    uint32_t healthInterval;
+    uint16_t healthTimeout;
+    std::atomic<bool> healthCheckStarted;
+    std::shared_ptr<std::atomic<bool> > stopped;
+};
+}
+
+#endif // __XRDPROXYPREFIX_PROXIES_HH___
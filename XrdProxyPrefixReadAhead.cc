@@ -0,0 +1,247 @@
+/********************************************************************************
+ *    Copyright (C) 2014 GSI Helmholtzzentrum fuer Schwerionenforschung GmbH *
+ *                                                                              *
+ *              This software is distributed under the terms of the *
+ *         GNU Lesser General Public Licence version 3 (LGPL) version 3, *
+ *                  copied verbatim in the file "LICENSE" *
+ ********************************************************************************/
+
+#include "XrdProxyPrefixReadAhead.hh"
+#include "XrdCl/XrdClDefaultEnv.hh"
+#include "XrdCl/XrdClLog.hh"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+using namespace XrdCl;
+
+namespace ProxyPrefix {
+uint32_t ReadAhead::blockSize = 1048576;
+uint32_t ReadAhead::maxBlocks = 8;
+
+//----------------------------------------------------------------------------
+// Hands the result of a prefetch back to the read-ahead
+//----------------------------------------------------------------------------
+class ReadAhead::BlockHandler : public XrdCl::ResponseHandler {
+  private:
+    StatePtr state;
+    BlockPtr block;
+
+  public:
+    BlockHandler(const StatePtr& s, const BlockPtr& b) : state(s), block(b) {}
+
+    virtual void HandleResponseWithHosts(XRootDStatus* status, AnyObject* response,
+                                         HostList* hostList) {
+        uint32_t bytesRead = 0;
+        if (status->IsOK() && response) {
+            ChunkInfo* chunk = 0;
+            response->Get(chunk);
+            if (chunk)
+                bytesRead = chunk->length;
+        }
+        delete response;
+        delete hostList;
+        state->OnBlock(block, status, bytesRead);
+        delete status;
+        delete this;
+    }
+};
+
+ReadAhead::State::State(ReadSource* s)
+  : source(s), nextOffset(0), eof(std::numeric_limits<uint64_t>::max()), sequentialReads(0),
+    window(0), lastTimeout(0) {}
+
+ReadAhead::ReadAhead(ReadSource& s) : state(std::make_shared<State>(&s)) {}
+
+ReadAhead::~ReadAhead() {
+    Reset();
+    std::lock_guard<std::mutex> lock(state->mtx);
+    state->source = 0;
+}
+
+void ReadAhead::setLimits(uint32_t size, uint32_t blocks) {
+    blockSize = std::max<uint32_t>(size, 1);
+    maxBlocks = blocks;
+}
+
+bool ReadAhead::Read(uint64_t offset, uint32_t length, void* buffer,
+                     XrdCl::ResponseHandler* handler, uint16_t timeout) {
+    if (maxBlocks == 0)
+        return false;
+
+    State& s = *state;
+    std::vector<BlockPtr> issue;
+    std::vector<Completion> done;
+    bool served = false;
+    {
+        std::lock_guard<std::mutex> lock(s.mtx);
+        s.lastTimeout = timeout;
+        bool hit = !s.blocks.empty() && offset >= s.blocks.front()->offset &&
+                   offset < s.blocks.back()->offset + s.blocks.back()->size;
+        if (hit) {
+            if (offset >= s.blocks.front()->offset + s.blocks.front()->size)
+                s.window = std::min(s.window * 2, maxBlocks);
+        } else {
+            s.sequentialReads = (offset == s.nextOffset) ? s.sequentialReads + 1 : 0;
+            s.Discard();
+            if (s.sequentialReads >= sequentialThreshold)
+                s.window = 1;
+        }
+        s.nextOffset = offset + length;
+
+        if (s.window) {
+            //----------------------------------------------------------------
+            // Forget the blocks nobody is going to ask for anymore and keep
+            // the window filled ahead of the reader
+            //----------------------------------------------------------------
+            uint64_t keep =
+              s.waiters.empty() ? offset : std::min(offset, s.waiters.front().offset);
+            while (!s.blocks.empty() && s.blocks.front()->offset + s.blocks.front()->size <= keep) {
+                s.blocks.front()->discarded = true;
+                s.blocks.pop_front();
+            }
+            uint64_t next =
+              s.blocks.empty() ? offset : s.blocks.back()->offset + s.blocks.back()->size;
+            while (next < s.eof && (next < offset + length || s.blocks.size() < s.window)) {
+                BlockPtr block = std::make_shared<Block>(next, blockSize);
+                s.blocks.push_back(block);
+                issue.push_back(block);
+                next += blockSize;
+            }
+            Waiter w = { offset, length, static_cast<char*>(buffer), handler };
+            s.waiters.push_back(w);
+            served = true;
+        }
+        s.Serve(done);
+    }
+
+    for (auto& block : issue) {
+        BlockHandler* blockHandler = new BlockHandler(state, block);
+        XRootDStatus st = s.source->Read(block->offset, block->size, block->data.data(),
+                                         blockHandler, timeout);
+        if (!st.IsOK()) {
+            delete blockHandler;
+            XRootDStatus* status = new XRootDStatus(st);
+            s.OnBlock(block, status, 0);
+            delete status;
+        }
+    }
+    s.Complete(done, timeout);
+    return served;
+}
+
+void ReadAhead::Reset() {
+    State& s = *state;
+    std::vector<Completion> done;
+    uint16_t timeout;
+    {
+        std::lock_guard<std::mutex> lock(s.mtx);
+        s.Discard();
+        s.sequentialReads = 0;
+        s.Serve(done);
+        timeout = s.lastTimeout;
+    }
+    s.Complete(done, timeout);
+}
+
+//----------------------------------------------------------------------------
+// The user handlers are only called once the lock is released, they may
+// well call back into the file
+//----------------------------------------------------------------------------
+void ReadAhead::State::OnBlock(const BlockPtr& block, XrdCl::XRootDStatus* status,
+                               uint32_t bytesRead) {
+    std::vector<Completion> done;
+    uint16_t timeout;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        block->done = true;
+        if (!status->IsOK()) {
+            block->status = *status;
+        } else if (bytesRead < block->size) {
+            block->size = bytesRead;
+            if (!block->discarded) {
+                eof = block->offset + bytesRead;
+                while (!blocks.empty() && blocks.back()->offset >= eof && blocks.back() != block) {
+                    blocks.back()->discarded = true;
+                    blocks.pop_back();
+                }
+            }
+        }
+        if (!block->discarded)
+            Serve(done);
+        timeout = lastTimeout;
+    }
+    Complete(done, timeout);
+}
+
+void ReadAhead::State::Discard() {
+    for (auto& block : blocks)
+        block->discarded = true;
+    blocks.clear();
+    window = 0;
+    eof = std::numeric_limits<uint64_t>::max();
+}
+
+//----------------------------------------------------------------------------
+// Hand out the data to the waiting reads in order, reads that cannot be
+// served from the blocks anymore are forwarded to the source
+//----------------------------------------------------------------------------
+void ReadAhead::State::Serve(std::vector<Completion>& done) {
+    while (!waiters.empty()) {
+        const Waiter& w = waiters.front();
+        uint64_t end = std::min<uint64_t>(w.offset + w.length, eof);
+        uint64_t pos = w.offset;
+        bool failed = false;
+        for (auto& block : blocks) {
+            if (pos >= end)
+                break;
+            if (block->offset + block->size <= pos)
+                continue;
+            if (block->offset > pos)
+                break;
+            if (!block->done)
+                return;
+            if (!block->status.IsOK()) {
+                failed = true;
+                break;
+            }
+            pos = block->offset + block->size;
+        }
+
+        Completion c = { w, 0, failed || pos < end };
+        if (!c.forward && end > w.offset) {
+            for (auto& block : blocks) {
+                uint64_t from = std::max(block->offset, w.offset);
+                uint64_t to = std::min(block->offset + block->size, end);
+                if (from < to)
+                    memcpy(w.buffer + (from - w.offset),
+                           block->data.data() + (from - block->offset), to - from);
+            }
+            c.length = end - w.offset;
+        }
+        if (failed) {
+            XrdCl::Log* log = XrdCl::DefaultEnv::GetLog();
+            log->Debug(1, "ReadAhead: prefetch failed, falling back to direct reads");
+            Discard();
+            sequentialReads = 0;
+        }
+        done.push_back(c);
+        waiters.pop_front();
+    }
+}
+
+void ReadAhead::State::Complete(std::vector<Completion>& done, uint16_t timeout) {
+    for (auto& c : done) {
+        const Waiter& w = c.waiter;
+        if (c.forward) {
+            XRootDStatus st = source->Read(w.offset, w.length, w.buffer, w.handler, timeout);
+            if (!st.IsOK())
+                w.handler->HandleResponseWithHosts(new XRootDStatus(st), 0, new HostList());
+            continue;
+        }
+        AnyObject* obj = new AnyObject();
+        obj->Set(new ChunkInfo(w.offset, c.length, w.buffer));
+        w.handler->HandleResponseWithHosts(new XRootDStatus(), obj, new HostList());
+    }
+}
+}
@@ -0,0 +1,116 @@
+/********************************************************************************
+ *    Copyright (C) 2014 GSI Helmholtzzentrum fuer Schwerionenforschung GmbH *
+ *                                                                              *
+ *              This software is distributed under the terms of the *
+ *         GNU Lesser General Public Licence version 3 (LGPL) version 3, *
+ *                  copied verbatim in the file "LICENSE" *
+ ********************************************************************************/
+#ifndef __XRDPROXYPREFIX_READAHEAD_HH___
+#define __XRDPROXYPREFIX_READAHEAD_HH___
+#include "XrdProxyPrefixReadSource.hh"
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace ProxyPrefix {
+//----------------------------------------------------------------------------
+// Sequential read-ahead for a single file: once a stream of back-to-back
+// reads is detected, a window of asynchronous block reads is kept in flight
+// ahead of the reader and subsequent reads are served from those blocks.
+// The window doubles whenever the reader moves on to the next prefetched
+// block and collapses on random access. The prefetches in flight only
+// hold on to the shared state, so neither Close nor the destructor has to
+// wait for them.
+//----------------------------------------------------------------------------
+class ReadAhead {
+  public:
+    //------------------------------------------------------------------------
+    // Constructor, the source has to outlive the read-ahead
+    //------------------------------------------------------------------------
+    ReadAhead(ReadSource& source);
+
+    //------------------------------------------------------------------------
+    // Destructor, prefetches still in flight are dropped when they complete
+    //------------------------------------------------------------------------
+    ~ReadAhead();
+
+    //------------------------------------------------------------------------
+    // Block size and maximum number of blocks in flight, 0 disables
+    //------------------------------------------------------------------------
+    static void setLimits(uint32_t blockSize, uint32_t maxBlocks);
+
+    //------------------------------------------------------------------------
+    // Serve the read from the prefetched blocks, returns false if the read
+    // is not part of a sequential stream and has to be forwarded as is
+    //------------------------------------------------------------------------
+    bool Read(uint64_t offset, uint32_t length, void* buffer, XrdCl::ResponseHandler* handler,
+              uint16_t timeout);
+
+    //------------------------------------------------------------------------
+    // Drop the prefetched data, e.g. after the file was modified or before
+    // it is closed
+    //------------------------------------------------------------------------
+    void Reset();
+
+  private:
+    struct Block {
+        Block(uint64_t off, uint32_t sz) : offset(off), size(sz), done(false), discarded(false) {
+            data.resize(sz);
+        }
+        uint64_t offset;
+        uint32_t size;
+        std::vector<char> data;
+        XrdCl::XRootDStatus status;
+        bool done;
+        bool discarded;
+    };
+    typedef std::shared_ptr<Block> BlockPtr;
+
+    struct Waiter {
+        uint64_t offset;
+        uint32_t length;
+        char* buffer;
+        XrdCl::ResponseHandler* handler;
+    };
+
+    struct Completion {
+        Waiter waiter;
+        uint32_t length;
+        bool forward;
+    };
+
+    //------------------------------------------------------------------------
+    // Everything the prefetches touch, they keep it alive until they are
+    // done. The source is cleared once the read-ahead is gone.
+    //------------------------------------------------------------------------
+    struct State {
+        State(ReadSource* s);
+        void Discard();
+        void Serve(std::vector<Completion>& done);
+        void Complete(std::vector<Completion>& done, uint16_t timeout);
+        void OnBlock(const BlockPtr& block, XrdCl::XRootDStatus* status, uint32_t bytesRead);
+
+        ReadSource* source;
+        std::mutex mtx;
+        std::deque<BlockPtr> blocks;
+        std::deque<Waiter> waiters;
+        uint64_t nextOffset;
+        uint64_t eof;
+        int sequentialReads;
+        uint32_t window;
+        uint16_t lastTimeout;
+    };
+    typedef std::shared_ptr<State> StatePtr;
+
+    class BlockHandler;
+
+    static uint32_t blockSize;
+    static uint32_t maxBlocks;
+    static const int sequentialThreshold = 2;
+
+    StatePtr state;
+};
+}
+
+#endif // __XRDPROXYPREFIX_READAHEAD_HH___
@@ -0,0 +1,25 @@
+/********************************************************************************
+ *    Copyright (C) 2014 GSI Helmholtzzentrum fuer Schwerionenforschung GmbH *
+ *                                                                              *
+ *              This software is distributed under the terms of the *
+ *         GNU Lesser General Public Licence version 3 (LGPL) version 3, *
+ *                  copied verbatim in the file "LICENSE" *
+ ********************************************************************************/
+#ifndef __XRDPROXYPREFIX_READSOURCE_HH___
+#define __XRDPROXYPREFIX_READSOURCE_HH___
+#include "XrdCl/XrdClXRootDResponses.hh"
+
+namespace ProxyPrefix {
+//----------------------------------------------------------------------------
+// Where the read-ahead and the block cache get their data from, same
+// semantics as XrdCl::File::Read
+//----------------------------------------------------------------------------
+class ReadSource {
+  public:
+    virtual ~ReadSource() {}
+    virtual XrdCl::XRootDStatus Read(uint64_t offset, uint32_t size, void* buffer,
+                                     XrdCl::ResponseHandler* handler, uint16_t timeout) = 0;
+};
+}
+
+#endif // __XRDPROXYPREFIX_READSOURCE_HH___
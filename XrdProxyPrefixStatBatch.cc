@@ -0,0 +1,300 @@
+/********************************************************************************
+ *    Copyright (C) 2014 GSI Helmholtzzentrum fuer Schwerionenforschung GmbH *
+ *                                                                              *
+ *              This software is distributed under the terms of the *
+ *         GNU Lesser General Public Licence version 3 (LGPL) version 3, *
+ *                  copied verbatim in the file "LICENSE" *
+ ********************************************************************************/
+
+#include "XrdProxyPrefixStatBatch.hh"
+#include "XrdCl/XrdClDefaultEnv.hh"
+#include "XrdCl/XrdClLog.hh"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+
+using namespace XrdCl;
+
+namespace {
+//----------------------------------------------------------------------------
+// Split the path into its directory and name, false if it has no parent
+//----------------------------------------------------------------------------
+bool splitPath(const std::string& path, std::string& dir, std::string& name) {
+    size_t end = path.find_last_not_of('/');
+    if (end == std::string::npos)
+        return false;
+    size_t slash = path.rfind('/', end);
+    if (slash == std::string::npos)
+        return false;
+    name = path.substr(slash + 1, end - slash);
+    size_t dirEnd = path.find_last_not_of('/', slash);
+    dir = dirEnd == std::string::npos ? "/" : path.substr(0, dirEnd + 1);
+    return true;
+}
+
+//----------------------------------------------------------------------------
+// One path per line, empty lines are skipped
+//----------------------------------------------------------------------------
+std::vector<std::string> splitLines(const std::string& value) {
+    std::vector<std::string> lines;
+    size_t pos = 0;
+    while (pos < value.size()) {
+        size_t end = value.find('\n', pos);
+        if (end == std::string::npos)
+            end = value.size();
+        if (end > pos)
+            lines.push_back(value.substr(pos, end - pos));
+        pos = end + 1;
+    }
+    return lines;
+}
+
+//----------------------------------------------------------------------------
+// A Stat of one path or a DirList covering several
+//----------------------------------------------------------------------------
+struct Job {
+    bool list;
+    std::string path;
+    std::vector<size_t> members;
+};
+
+struct Result {
+    XrdCl::XRootDStatus status;
+    std::unique_ptr<XrdCl::StatInfo> info;
+};
+}
+
+namespace ProxyPrefix {
+uint32_t StatBatch::defaultWindow = 64;
+uint32_t StatBatch::defaultGroupMin = 0;
+
+//----------------------------------------------------------------------------
+// The state of one run, it lives until all its responses are in
+//----------------------------------------------------------------------------
+class StatBatch::Batch {
+  public:
+    Batch(XrdCl::FileSystemPlugIn& f, std::vector<std::string>& p, uint32_t w, uint32_t g)
+      : fs(f), window(w), groupMin(g), results(p.size()), inFlight(0) {
+        paths.swap(p);
+    }
+
+    void Run(std::string& out);
+    void Complete(const Job& job, XrdCl::XRootDStatus* status, XrdCl::AnyObject* response);
+
+  private:
+    void Plan();
+    void Send(const Job& job);
+    void Fail(const Job& job, const XrdCl::XRootDStatus& status);
+
+    XrdCl::FileSystemPlugIn& fs;
+    uint32_t window;
+    uint32_t groupMin;
+    std::vector<std::string> paths;
+
+    std::mutex mtx;
+    std::condition_variable cond;
+    std::deque<Job> jobs;
+    std::vector<Result> results;
+    uint32_t inFlight;
+};
+
+//----------------------------------------------------------------------------
+// Hands the response of a job back to the batch
+//----------------------------------------------------------------------------
+class StatBatch::BatchHandler : public XrdCl::ResponseHandler {
+  private:
+    Batch* batch;
+    Job job;
+
+  public:
+    BatchHandler(Batch* b, const Job& j) : batch(b), job(j) {}
+
+    virtual void HandleResponseWithHosts(XRootDStatus* status, AnyObject* response,
+                                         HostList* hostList) {
+        batch->Complete(job, status, response);
+        delete status;
+        delete response;
+        delete hostList;
+        delete this;
+    }
+};
+
+StatBatch::StatBatch(XrdCl::FileSystemPlugIn& f)
+  : fs(f), window(defaultWindow), groupMin(defaultGroupMin) {}
+
+void StatBatch::setLimits(uint32_t w, uint32_t g) {
+    defaultWindow = std::max<uint32_t>(w, 1);
+    defaultGroupMin = g;
+}
+
+bool StatBatch::SetProperty(const std::string& name, const std::string& value) {
+    if (name == "StatBatch") {
+        std::vector<std::string> lines = splitLines(value);
+        std::lock_guard<std::mutex> lock(mtx);
+        paths.swap(lines);
+        return true;
+    }
+    if (name == "StatBatchWindow" || name == "StatBatchGroup") {
+        char* end = 0;
+        unsigned long n = std::strtoul(value.c_str(), &end, 10);
+        if (end == value.c_str() || *end != 0)
+            return false;
+        std::lock_guard<std::mutex> lock(mtx);
+        if (name == "StatBatchWindow")
+            window = std::max<unsigned long>(n, 1);
+        else
+            groupMin = n;
+        return true;
+    }
+    return false;
+}
+
+void StatBatch::Run(std::string& value) const {
+    std::vector<std::string> batchPaths = splitLines(value);
+    uint32_t batchWindow, batchGroupMin;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (batchPaths.empty())
+            batchPaths = paths;
+        batchWindow = window;
+        batchGroupMin = groupMin;
+    }
+    Batch batch(fs, batchPaths, batchWindow, batchGroupMin);
+    batch.Run(value);
+}
+
+//----------------------------------------------------------------------------
+// One Stat per path, or one DirList per directory holding enough of them
+//----------------------------------------------------------------------------
+void StatBatch::Batch::Plan() {
+    std::unordered_map<std::string, std::vector<size_t> > dirs;
+    std::vector<std::string> order;
+    std::string dir, name;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        if (!groupMin || !splitPath(paths[i], dir, name)) {
+            jobs.push_back(Job{ false, paths[i], std::vector<size_t>(1, i) });
+            continue;
+        }
+        auto& members = dirs[dir];
+        if (members.empty())
+            order.push_back(dir);
+        members.push_back(i);
+    }
+    for (auto& d : order) {
+        auto& members = dirs[d];
+        if (members.size() >= groupMin) {
+            jobs.push_back(Job{ true, d, members });
+            continue;
+        }
+        for (size_t i : members)
+            jobs.push_back(Job{ false, paths[i], std::vector<size_t>(1, i) });
+    }
+}
+
+void StatBatch::Batch::Run(std::string& out) {
+    XrdCl::Log* log = XrdCl::DefaultEnv::GetLog();
+    log->Debug(1, "XrdProxyPrefix: stat batch of %zu paths", paths.size());
+    std::unique_lock<std::mutex> lock(mtx);
+    Plan();
+    for (;;) {
+        cond.wait(lock, [this] {
+            return (!jobs.empty() && inFlight < window) || (jobs.empty() && inFlight == 0);
+        });
+        if (jobs.empty())
+            break;
+        Job job = jobs.front();
+        jobs.pop_front();
+        ++inFlight;
+        // the answer may come from a cache before the call returns
+        lock.unlock();
+        Send(job);
+        lock.lock();
+    }
+
+    out.clear();
+    for (auto& r : results) {
+        if (r.status.IsOK() && r.info) {
+            out.append("ok ").append(r.info->GetId());
+            out.append(1, ' ').append(std::to_string(r.info->GetSize()));
+            out.append(1, ' ').append(std::to_string(r.info->GetFlags()));
+            out.append(1, ' ').append(std::to_string(r.info->GetModTime()));
+        } else {
+            std::string msg = r.status.ToString();
+            std::replace(msg.begin(), msg.end(), '\n', ' ');
+            out.append("error ").append(std::to_string(r.status.errNo));
+            out.append(1, ' ').append(msg);
+        }
+        out.append(1, '\n');
+    }
+}
+
+void StatBatch::Batch::Send(const Job& job) {
+    BatchHandler* handler = new BatchHandler(this, job);
+    XRootDStatus st = job.list ? fs.DirList(job.path, DirListFlags::Stat, handler, 0)
+                               : fs.Stat(job.path, handler, 0);
+    if (st.IsOK())
+        return;
+    delete handler;
+    std::lock_guard<std::mutex> lock(mtx);
+    Fail(job, st);
+}
+
+//----------------------------------------------------------------------------
+// Called with the lock held: a failed listing falls back to single Stats
+//----------------------------------------------------------------------------
+void StatBatch::Batch::Fail(const Job& job, const XrdCl::XRootDStatus& status) {
+    --inFlight;
+    if (job.list) {
+        for (size_t i : job.members)
+            jobs.push_back(Job{ false, paths[i], std::vector<size_t>(1, i) });
+    } else {
+        results[job.members[0]].status = status;
+    }
+    cond.notify_all();
+}
+
+void StatBatch::Batch::Complete(const Job& job, XrdCl::XRootDStatus* status,
+                                XrdCl::AnyObject* response) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!status->IsOK() || !response) {
+        Fail(job, status->IsOK() ? XRootDStatus(stError, errInternal) : *status);
+        return;
+    }
+    if (!job.list) {
+        StatInfo* info = 0;
+        response->Get(info);
+        Result& r = results[job.members[0]];
+        if (info)
+            r.info.reset(new StatInfo(*info));
+        else
+            r.status = XRootDStatus(stError, errInternal);
+        --inFlight;
+        cond.notify_all();
+        return;
+    }
+
+    DirectoryList* list = 0;
+    response->Get(list);
+    std::unordered_map<std::string, StatInfo*> entries;
+    if (list)
+        for (auto it = list->Begin(); it != list->End(); ++it)
+            if ((*it)->GetStatInfo())
+                entries[(*it)->GetName()] = (*it)->GetStatInfo();
+    std::string dir, name;
+    for (size_t i : job.members) {
+        splitPath(paths[i], dir, name);
+        auto it = entries.find(name);
+        if (it == entries.end()) {
+            // missing from the listing, let the Stat give the real answer
+            jobs.push_back(Job{ false, paths[i], std::vector<size_t>(1, i) });
+            continue;
+        }
+        results[i].info.reset(new StatInfo(*it->second));
+    }
+    --inFlight;
+    cond.notify_all();
+}
+}
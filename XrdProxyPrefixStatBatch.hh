@@ -0,0 +1,66 @@
+/********************************************************************************
+ *    Copyright (C) 2014 GSI Helmholtzzentrum fuer Schwerionenforschung GmbH *
+ *                                                                              *
+ *              This software is distributed under the terms of the *
+ *         GNU Lesser General Public Licence version 3 (LGPL) version 3, *
+ *                  copied verbatim in the file "LICENSE" *
+ ********************************************************************************/
+#ifndef __XRDPROXYPREFIX_STATBATCH_HH___
+#define __XRDPROXYPREFIX_STATBATCH_HH___
+#include "XrdCl/XrdClPlugInInterface.hh"
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace ProxyPrefix {
+//----------------------------------------------------------------------------
+// Stat of many paths at once through the properties of a file system:
+//   SetProperty("StatBatch", paths)         one path per line
+//   SetProperty("StatBatchWindow", n)       requests kept in flight
+//   SetProperty("StatBatchGroup", n)        list directories with at least
+//                                           n of the paths instead, 0 = off
+//   GetProperty("StatBatch", results)       runs the batch
+// The results come in the order of the paths, one line each, either
+// "ok <id> <size> <flags> <modtime>" or "error <errNo> <message>". The
+// paths can also be passed in the value of GetProperty, which is how
+// threads sharing the file system keep their batches apart.
+//----------------------------------------------------------------------------
+class StatBatch {
+  public:
+    //------------------------------------------------------------------------
+    // Constructor, the file system has to outlive the batch
+    //------------------------------------------------------------------------
+    StatBatch(XrdCl::FileSystemPlugIn& fs);
+
+    //------------------------------------------------------------------------
+    // Defaults of the window and the grouping threshold
+    //------------------------------------------------------------------------
+    static void setLimits(uint32_t window, uint32_t groupMin);
+
+    //------------------------------------------------------------------------
+    // Handle one of the properties above, false for any other
+    //------------------------------------------------------------------------
+    bool SetProperty(const std::string& name, const std::string& value);
+
+    //------------------------------------------------------------------------
+    // Stat the paths in the value, the ones set before if it is empty, and
+    // wait for all of them; the value is replaced by the results
+    //------------------------------------------------------------------------
+    void Run(std::string& value) const;
+
+  private:
+    class Batch;
+    class BatchHandler;
+
+    static uint32_t defaultWindow;
+    static uint32_t defaultGroupMin;
+
+    XrdCl::FileSystemPlugIn& fs;
+    mutable std::mutex mtx; //< guards the settings, a run works on a copy
+    uint32_t window;
+    uint32_t groupMin;
+    std::vector<std::string> paths;
+};
+}
+
+#endif // __XRDPROXYPREFIX_STATBATCH_HH___
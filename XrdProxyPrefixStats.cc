@@ -0,0 +1,345 @@
+/********************************************************************************
+ *    Copyright (C) 2014 GSI Helmholtzzentrum fuer Schwerionenforschung GmbH *
+ *                                                                              *
+ *              This software is distributed under the terms of the *
+ *         GNU Lesser General Public Licence version 3 (LGPL) version 3, *
+ *                  copied verbatim in the file "LICENSE" *
+ ********************************************************************************/
+
+#include "XrdProxyPrefixStats.hh"
+#include "XrdCl/XrdClDefaultEnv.hh"
+#include "XrdCl/XrdClLog.hh"
+#include "XrdCl/XrdClPostMaster.hh"
+#include "XrdCl/XrdClTaskManager.hh"
+#include "XrdProxyPrefixProxies.hh"
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <numeric>
+
+using namespace XrdCl;
+
+namespace {
+typedef std::chrono::steady_clock Clock;
+
+const char* opNames[ProxyPrefix::Stats::opCount] = {
+    // file
+    "Open", "Close", "Read", "Write", "VectorRead", "Sync", "Truncate", "Stat", "Fcntl", "Visa",
+    // file system
+    "Locate", "Mv", "Query", "FsTruncate", "Rm", "MkDir", "RmDir", "ChMod", "Ping", "FsStat",
+    "StatVFS", "Protocol", "DirList", "SendInfo", "Prepare"
+};
+
+// values below 2 * subBuckets get a bucket each, larger ones 1/16 of their
+// power of two up to 2^40 us
+const uint32_t subBits = 4;
+const uint32_t subBuckets = 1 << subBits;
+const uint32_t maxExponent = 40;
+const size_t bucketCount = 2 * subBuckets + (maxExponent - subBits) * subBuckets;
+
+size_t bucketOf(uint64_t micros) {
+    if (micros < 2 * subBuckets)
+        return micros;
+    uint32_t exponent = 63 - __builtin_clzll(micros);
+    size_t bucket = 2 * subBuckets + (exponent - subBits - 1) * subBuckets +
+                    ((micros >> (exponent - subBits)) & (subBuckets - 1));
+    return std::min(bucket, bucketCount - 1);
+}
+
+// the largest value of the bucket
+uint64_t bucketValue(size_t bucket) {
+    if (bucket < 2 * subBuckets)
+        return bucket;
+    uint32_t exponent = (bucket - 2 * subBuckets) / subBuckets + subBits + 1;
+    uint64_t sub = (bucket - 2 * subBuckets) % subBuckets;
+    return ((subBuckets + sub + 1) << (exponent - subBits)) - 1;
+}
+
+struct ThreadShard {
+    uint64_t owner;
+    void* shard;
+};
+thread_local ThreadShard currentShard = { 0, 0 };
+std::atomic<uint64_t> nextStatsId(1);
+}
+
+namespace ProxyPrefix {
+//----------------------------------------------------------------------------
+// Written by a single thread, read by the dump
+//----------------------------------------------------------------------------
+struct Stats::Histogram {
+    std::atomic<uint64_t> buckets[bucketCount];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> errors;
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> max;
+
+    Histogram() : count(0), errors(0), bytes(0), sum(0), max(0) {
+        for (auto& b : buckets)
+            b.store(0, std::memory_order_relaxed);
+    }
+
+    static void Add(std::atomic<uint64_t>& counter, uint64_t n) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+};
+
+//----------------------------------------------------------------------------
+// The histograms of one thread, created on first use
+//----------------------------------------------------------------------------
+struct Stats::Shard {
+    std::thread::id thread;
+    std::vector<std::atomic<Histogram*> > histograms;
+
+    Shard(size_t n) : thread(std::this_thread::get_id()), histograms(n) {
+        for (auto& h : histograms)
+            h.store(0, std::memory_order_relaxed);
+    }
+
+    ~Shard() {
+        for (auto& h : histograms)
+            delete h.load();
+    }
+
+    Histogram* Get(size_t i) {
+        Histogram* h = histograms[i].load(std::memory_order_acquire);
+        if (!h) {
+            h = new Histogram();
+            histograms[i].store(h, std::memory_order_release);
+        }
+        return h;
+    }
+};
+
+//----------------------------------------------------------------------------
+// The histograms of all threads, the dump task only holds a weak reference
+//----------------------------------------------------------------------------
+struct Stats::State {
+    State(const std::vector<std::string>& n, const std::string& f)
+      : id(nextStatsId++), names(n), file(f) {}
+
+    const uint64_t id;
+    const std::vector<std::string> names;
+    const std::string file;
+    mutable std::mutex mtx;
+    std::vector<std::unique_ptr<Shard> > shards;
+
+    std::string Dump() const;
+    void Write() const;
+};
+
+std::string Stats::State::Dump() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::string out;
+    std::vector<uint64_t> buckets(bucketCount);
+    for (size_t i = 0; i < names.size() * opCount; ++i) {
+        std::fill(buckets.begin(), buckets.end(), 0);
+        uint64_t count = 0, errors = 0, bytes = 0, sum = 0, max = 0;
+        for (auto& shard : shards) {
+            const Histogram* h = shard->histograms[i].load(std::memory_order_acquire);
+            if (!h)
+                continue;
+            for (size_t b = 0; b < bucketCount; ++b)
+                buckets[b] += h->buckets[b].load(std::memory_order_relaxed);
+            count += h->count.load(std::memory_order_relaxed);
+            errors += h->errors.load(std::memory_order_relaxed);
+            bytes += h->bytes.load(std::memory_order_relaxed);
+            sum += h->sum.load(std::memory_order_relaxed);
+            max = std::max(max, h->max.load(std::memory_order_relaxed));
+        }
+        if (!count)
+            continue;
+
+        // the buckets may be a little ahead of the count, read at another time
+        uint64_t total = std::accumulate(buckets.begin(), buckets.end(), uint64_t(0));
+        const double quantiles[] = { 0.5, 0.9, 0.99 };
+        uint64_t values[3] = { 0, 0, 0 };
+        uint64_t seen = 0;
+        size_t q = 0;
+        for (size_t b = 0; b < bucketCount && q < 3; ++b) {
+            seen += buckets[b];
+            while (q < 3 && seen && seen >= quantiles[q] * total)
+                values[q++] = std::min(bucketValue(b), max);
+        }
+        out.append("endpoint=").append(names[i / opCount]);
+        out.append(" op=").append(opNames[i % opCount]);
+        out.append(" count=").append(std::to_string(count));
+        out.append(" errors=").append(std::to_string(errors));
+        out.append(" bytes=").append(std::to_string(bytes));
+        out.append(" mean_us=").append(std::to_string(sum / count));
+        out.append(" p50_us=").append(std::to_string(values[0]));
+        out.append(" p90_us=").append(std::to_string(values[1]));
+        out.append(" p99_us=").append(std::to_string(values[2]));
+        out.append(" max_us=").append(std::to_string(max));
+        out.append(1, '\n');
+    }
+    return out;
+}
+
+//----------------------------------------------------------------------------
+// Replace the file, readers never see half a dump
+//----------------------------------------------------------------------------
+void Stats::State::Write() const {
+    std::string text = "# XrdProxyPrefix stats " + std::to_string(time(0)) + "\n" + Dump();
+    std::string tmp = file + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "w");
+    bool ok = f && fwrite(text.data(), 1, text.size(), f) == text.size();
+    ok = f && fclose(f) == 0 && ok;
+    if (ok && rename(tmp.c_str(), file.c_str()) == 0)
+        return;
+    XrdCl::Log* log = XrdCl::DefaultEnv::GetLog();
+    log->Warning(1, "XrdProxyPrefix: cannot write the stats to %s", file.c_str());
+    remove(tmp.c_str());
+}
+
+//----------------------------------------------------------------------------
+// Writes the dump every interval seconds, ends once the statistics are gone
+//----------------------------------------------------------------------------
+class Stats::Dumper : public XrdCl::Task {
+  private:
+    std::weak_ptr<State> state;
+    uint32_t interval;
+
+  public:
+    Dumper(const std::shared_ptr<State>& s, uint32_t i) : state(s), interval(i) {
+        SetName("XrdProxyPrefix stats");
+    }
+
+    virtual time_t Run(time_t now) {
+        std::shared_ptr<State> s = state.lock();
+        if (!s)
+            return 0;
+        s->Write();
+        return now + interval;
+    }
+};
+
+//----------------------------------------------------------------------------
+// Records the latency once the response is there
+//----------------------------------------------------------------------------
+class TimedHandler : public XrdCl::ResponseHandler {
+  private:
+    Stats* stats;
+    size_t endpoint;
+    Stats::Op op;
+    XrdCl::ResponseHandler* handler;
+    uint64_t bytes;
+    Clock::time_point start;
+
+  public:
+    TimedHandler(Stats* s, size_t e, Stats::Op o, XrdCl::ResponseHandler* h, uint64_t b)
+      : stats(s), endpoint(e), op(o), handler(h), bytes(b), start(Clock::now()) {}
+
+    uint64_t Elapsed() const {
+        return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start)
+          .count();
+    }
+
+    void SetEndpoint(size_t e) { endpoint = e; }
+    void Failed() { stats->Record(endpoint, op, Elapsed(), false, 0); }
+
+    virtual void HandleResponseWithHosts(XRootDStatus* status, AnyObject* response,
+                                         HostList* hostList) {
+        if (response && op == Stats::Read) {
+            ChunkInfo* chunk = 0;
+            response->Get(chunk);
+            bytes = chunk ? chunk->length : 0;
+        } else if (response && op == Stats::VectorRead) {
+            VectorReadInfo* info = 0;
+            response->Get(info);
+            bytes = info ? info->GetSize() : 0;
+        }
+        bool ok = status->IsOK();
+        stats->Record(endpoint, op, Elapsed(), ok, ok ? bytes : 0);
+        if (handler)
+            handler->HandleResponseWithHosts(status, response, hostList);
+        else {
+            delete status;
+            delete response;
+            delete hostList;
+        }
+        delete this;
+    }
+};
+
+Stats::Stats(const ProxyList& proxies, const std::string& file, uint32_t interval)
+  : dumpInterval(std::max<uint32_t>(interval, 1)), started(file.empty()) {
+    std::vector<std::string> names(1, "direct");
+    endpoints.push_back(0);
+    for (size_t i = 0; i < proxies.Size(); ++i) {
+        endpoints.push_back(proxies.Get(i));
+        names.push_back(proxies.Get(i)->GetHostId());
+    }
+    state = std::make_shared<State>(names, file);
+}
+
+Stats::~Stats() {
+    if (!state->file.empty())
+        state->Write();
+}
+
+void Stats::Start() {
+    if (started.exchange(true))
+        return;
+    XrdCl::PostMaster* postMaster = XrdCl::DefaultEnv::GetPostMaster();
+    if (postMaster)
+        postMaster->GetTaskManager()->RegisterTask(new Dumper(state, dumpInterval),
+                                                   time(0) + dumpInterval, true);
+}
+
+size_t Stats::Endpoint(const ProxyEndpoint* endpoint) const {
+    auto it = std::find(endpoints.begin() + 1, endpoints.end(), endpoint);
+    return it == endpoints.end() ? 0 : it - endpoints.begin();
+}
+
+Stats::Shard* Stats::LocalShard() {
+    if (currentShard.owner == state->id)
+        return static_cast<Shard*>(currentShard.shard);
+    std::lock_guard<std::mutex> lock(state->mtx);
+    Shard* shard = 0;
+    for (auto& s : state->shards)
+        if (s->thread == std::this_thread::get_id())
+            shard = s.get();
+    if (!shard) {
+        state->shards.emplace_back(new Shard(endpoints.size() * opCount));
+        shard = state->shards.back().get();
+    }
+    currentShard.owner = state->id;
+    currentShard.shard = shard;
+    return shard;
+}
+
+void Stats::Record(size_t endpoint, Op op, uint64_t micros, bool ok, uint64_t bytes) {
+    Histogram* h = LocalShard()->Get(endpoint * opCount + op);
+    Histogram::Add(h->buckets[bucketOf(micros)], 1);
+    Histogram::Add(h->count, 1);
+    if (!ok)
+        Histogram::Add(h->errors, 1);
+    Histogram::Add(h->bytes, bytes);
+    Histogram::Add(h->sum, micros);
+    if (micros > h->max.load(std::memory_order_relaxed))
+        h->max.store(micros, std::memory_order_relaxed);
+}
+
+std::string Stats::Dump() const { return state->Dump(); }
+
+TimedRequest::TimedRequest(Stats* stats, size_t endpoint, Stats::Op op,
+                           XrdCl::ResponseHandler* h, uint64_t bytes)
+  : handler(h), wrapper(0) {
+    if (stats)
+        wrapper = new TimedHandler(stats, endpoint, op, handler, bytes);
+}
+
+void TimedRequest::SetEndpoint(size_t endpoint) {
+    if (wrapper)
+        static_cast<TimedHandler*>(wrapper)->SetEndpoint(endpoint);
+}
+
+TimedRequest::~TimedRequest() {
+    if (!wrapper)
+        return;
+    static_cast<TimedHandler*>(wrapper)->Failed();
+    delete wrapper;
+}
+}
@@ -0,0 +1,140 @@
+/********************************************************************************
+ *    Copyright (C) 2014 GSI Helmholtzzentrum fuer Schwerionenforschung GmbH *
+ *                                                                              *
+ *              This software is distributed under the terms of the *
+ *         GNU Lesser General Public Licence version 3 (LGPL) version 3, *
+ *                  copied verbatim in the file "LICENSE" *
+ ********************************************************************************/
+#ifndef __XRDPROXYPREFIX_STATS_HH___
+#define __XRDPROXYPREFIX_STATS_HH___
+#include "XrdCl/XrdClXRootDResponses.hh"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ProxyPrefix {
+class ProxyEndpoint;
+class ProxyList;
+
+//----------------------------------------------------------------------------
+// Latency histograms and counters per proxy endpoint and operation. Every
+// thread records into histograms of its own without locking, they are only
+// summed up for a dump. The latencies are kept in microseconds in
+// log-linear buckets of 1/16 of a power of two, like HDR histograms.
+//----------------------------------------------------------------------------
+class Stats {
+  public:
+    enum Op {
+        Open,
+        Close,
+        Read,
+        Write,
+        VectorRead,
+        Sync,
+        Truncate,
+        Stat,
+        Fcntl,
+        Visa,
+        Locate,
+        Mv,
+        Query,
+        FsTruncate,
+        Rm,
+        MkDir,
+        RmDir,
+        ChMod,
+        Ping,
+        FsStat,
+        StatVFS,
+        Protocol,
+        DirList,
+        SendInfo,
+        Prepare,
+        opCount
+    };
+
+    //------------------------------------------------------------------------
+    // Constructor, the endpoints are the proxies of the list and the direct
+    // access. The dump is written to the file every interval seconds once
+    // Start() was called, an empty file name only keeps the statistics for
+    // Dump().
+    //------------------------------------------------------------------------
+    Stats(const ProxyList& proxies, const std::string& file, uint32_t interval);
+
+    //------------------------------------------------------------------------
+    // Destructor, writes a last dump
+    //------------------------------------------------------------------------
+    ~Stats();
+
+    //------------------------------------------------------------------------
+    // Start the periodic dump on the XrdCl task manager
+    //------------------------------------------------------------------------
+    void Start();
+
+    //------------------------------------------------------------------------
+    // Index of the endpoint, 0 for the direct access
+    //------------------------------------------------------------------------
+    size_t Endpoint(const ProxyEndpoint* endpoint) const;
+
+    void Record(size_t endpoint, Op op, uint64_t micros, bool ok, uint64_t bytes);
+
+    //------------------------------------------------------------------------
+    // One line per endpoint and operation seen so far:
+    // endpoint=<host:port|direct> op=<name> count= errors= bytes= mean_us=
+    // p50_us= p90_us= p99_us= max_us=
+    //------------------------------------------------------------------------
+    std::string Dump() const;
+
+  private:
+    class Dumper;
+    struct Histogram;
+    struct Shard;
+    struct State;
+
+    Shard* LocalShard();
+
+    std::vector<const ProxyEndpoint*> endpoints; //< index 0 is the direct access
+    std::shared_ptr<State> state;
+    uint32_t dumpInterval;
+    std::atomic<bool> started;
+};
+
+//----------------------------------------------------------------------------
+// An operation timed from the call to the response, stats may be 0. The
+// request is sent with Handler() and the status of the send passed through
+// Sent(); a handler that was not handed over is deleted with the object
+// and the failed send counted as an error.
+//----------------------------------------------------------------------------
+class TimedRequest {
+  public:
+    TimedRequest(Stats* stats, size_t endpoint, Stats::Op op, XrdCl::ResponseHandler* handler,
+                 uint64_t bytes = 0);
+    ~TimedRequest();
+
+    XrdCl::ResponseHandler* Handler() const { return wrapper ? wrapper : handler; }
+
+    //------------------------------------------------------------------------
+    // The endpoint may change until the request is sent
+    //------------------------------------------------------------------------
+    void SetEndpoint(size_t endpoint);
+
+    XrdCl::XRootDStatus Sent(const XrdCl::XRootDStatus& status) {
+        if (status.IsOK())
+            wrapper = 0;
+        return status;
+    }
+
+  private:
+    TimedRequest(const TimedRequest&);
+    TimedRequest& operator=(const TimedRequest&);
+
+    XrdCl::ResponseHandler* handler;
+    XrdCl::ResponseHandler* wrapper;
+};
+}
+
+#endif // __XRDPROXYPREFIX_STATS_HH___
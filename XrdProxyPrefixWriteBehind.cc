@@ -0,0 +1,213 @@
+/********************************************************************************
+ *    Copyright (C) 2014 GSI Helmholtzzentrum fuer Schwerionenforschung GmbH *
+ *                                                                              *
+ *              This software is distributed under the terms of the *
+ *         GNU Lesser General Public Licence version 3 (LGPL) version 3, *
+ *                  copied verbatim in the file "LICENSE" *
+ ********************************************************************************/
+
+#include "XrdProxyPrefixWriteBehind.hh"
+#include "XrdCl/XrdClDefaultEnv.hh"
+#include "XrdCl/XrdClLog.hh"
+#include <algorithm>
+
+using namespace XrdCl;
+
+namespace ProxyPrefix {
+uint32_t WriteBehind::chunkSize = 0;
+uint32_t WriteBehind::maxInFlight = 4;
+
+//----------------------------------------------------------------------------
+// Keeps the data of a chunk until its write is done
+//----------------------------------------------------------------------------
+class WriteBehind::ChunkHandler : public XrdCl::ResponseHandler {
+  private:
+    WriteBehind* writeBehind;
+
+  public:
+    Range range;
+    std::vector<char> data;
+
+    ChunkHandler(WriteBehind* wb, uint64_t offset, std::vector<char>& d)
+      : writeBehind(wb), range(offset, offset + d.size()) {
+        data.swap(d);
+    }
+
+    virtual void HandleResponseWithHosts(XRootDStatus* status, AnyObject* response,
+                                         HostList* hostList) {
+        delete response;
+        delete hostList;
+        writeBehind->OnChunk(range, status);
+        delete status;
+        delete this;
+    }
+};
+
+//----------------------------------------------------------------------------
+// Ends a large write that went out unbuffered, then hands the response on
+// to the caller, who gets the error of the write itself
+//----------------------------------------------------------------------------
+class WriteBehind::PassHandler : public XrdCl::ResponseHandler {
+  private:
+    WriteBehind* writeBehind;
+    Range range;
+    XrdCl::ResponseHandler* handler;
+
+  public:
+    PassHandler(WriteBehind* wb, const Range& r, XrdCl::ResponseHandler* h)
+      : writeBehind(wb), range(r), handler(h) {}
+
+    virtual void HandleResponseWithHosts(XRootDStatus* status, AnyObject* response,
+                                         HostList* hostList) {
+        writeBehind->OnChunk(range, 0);
+        handler->HandleResponseWithHosts(status, response, hostList);
+        delete this;
+    }
+};
+
+//----------------------------------------------------------------------------
+// Turns the success of a Sync or Close into the error of an earlier write
+//----------------------------------------------------------------------------
+class WriteBehind::ReportHandler : public XrdCl::ResponseHandler {
+  private:
+    XrdCl::ResponseHandler* handler;
+    XRootDStatus error;
+
+  public:
+    ReportHandler(XrdCl::ResponseHandler* h, const XRootDStatus& e) : handler(h), error(e) {}
+
+    virtual void HandleResponseWithHosts(XRootDStatus* status, AnyObject* response,
+                                         HostList* hostList) {
+        if (status->IsOK())
+            *status = error;
+        handler->HandleResponseWithHosts(status, response, hostList);
+        delete this;
+    }
+};
+
+WriteBehind::WriteBehind(XrdCl::File* f) : file(f), bufferOffset(0), lastTimeout(0) {}
+
+WriteBehind::~WriteBehind() {
+    std::unique_lock<std::mutex> lock(mtx);
+    cond.wait(lock, [this] { return chunks.empty(); });
+}
+
+void WriteBehind::setLimits(uint32_t size, uint32_t writes) {
+    chunkSize = size;
+    maxInFlight = std::max<uint32_t>(writes, 1);
+}
+
+XRootDStatus WriteBehind::Write(uint64_t offset, uint32_t size, const void* data,
+                                XrdCl::ResponseHandler* handler, uint16_t timeout) {
+    std::lock_guard<std::mutex> writeLock(writeMtx);
+    {
+        // the write is refused with the error, which counts as reported
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!error.IsOK()) {
+            XRootDStatus st = error;
+            error = XRootDStatus();
+            return st;
+        }
+        lastTimeout = timeout;
+    }
+    XRootDStatus st;
+    if (!buffer.empty() && offset != bufferOffset + buffer.size()) {
+        st = Send(bufferOffset, buffer);
+        if (!st.IsOK())
+            return st;
+    }
+
+    // large writes go out as they are, once the chunks they overwrite are
+    // done, and stay in flight like a chunk so later writes wait for them
+    if (buffer.empty() && size >= chunkSize) {
+        std::unique_lock<std::mutex> lock(mtx);
+        Range range(offset, offset + size);
+        cond.wait(lock, [&] { return !Overlaps(range); });
+        chunks.push_back(range);
+        lock.unlock();
+        PassHandler* pass = new PassHandler(this, range, handler);
+        st = file->Write(offset, size, data, pass, timeout);
+        if (!st.IsOK()) {
+            delete pass;
+            lock.lock();
+            Remove(range);
+            cond.notify_all();
+        }
+        return st;
+    }
+    if (buffer.empty()) {
+        bufferOffset = offset;
+        buffer.reserve(chunkSize);
+    }
+    const char* bytes = static_cast<const char*>(data);
+    buffer.insert(buffer.end(), bytes, bytes + size);
+    if (buffer.size() >= chunkSize) {
+        st = Send(bufferOffset, buffer);
+        if (!st.IsOK())
+            return st;
+    }
+    handler->HandleResponseWithHosts(new XRootDStatus(), 0, new HostList());
+    return XRootDStatus();
+}
+
+XRootDStatus WriteBehind::Send(uint64_t offset, std::vector<char>& data) {
+    std::unique_lock<std::mutex> lock(mtx);
+    Range range(offset, offset + data.size());
+    cond.wait(lock, [&] { return chunks.size() < maxInFlight && !Overlaps(range); });
+    ChunkHandler* handler = new ChunkHandler(this, offset, data);
+    uint16_t timeout = lastTimeout;
+    chunks.push_back(range);
+    // the chunk may complete before Write returns
+    lock.unlock();
+    XRootDStatus st =
+      file->Write(offset, handler->data.size(), handler->data.data(), handler, timeout);
+    if (!st.IsOK()) {
+        delete handler;
+        lock.lock();
+        Remove(range);
+        if (error.IsOK())
+            error = st;
+        cond.notify_all();
+    }
+    return st;
+}
+
+bool WriteBehind::Overlaps(const Range& range) const {
+    for (const Range& c : chunks)
+        if (c.first < range.second && range.first < c.second)
+            return true;
+    return false;
+}
+
+void WriteBehind::Remove(const Range& range) {
+    chunks.erase(std::find(chunks.begin(), chunks.end(), range));
+}
+
+void WriteBehind::OnChunk(const Range& range, XrdCl::XRootDStatus* status) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (status && !status->IsOK() && error.IsOK()) {
+        XrdCl::Log* log = XrdCl::DefaultEnv::GetLog();
+        log->Warning(1, "XrdProxyPrefix: write-behind failed: %s", status->ToString().c_str());
+        error = *status;
+    }
+    Remove(range);
+    cond.notify_all();
+}
+
+void WriteBehind::Flush() {
+    std::lock_guard<std::mutex> writeLock(writeMtx);
+    if (!buffer.empty())
+        Send(bufferOffset, buffer);
+    std::unique_lock<std::mutex> lock(mtx);
+    cond.wait(lock, [this] { return chunks.empty(); });
+}
+
+XrdCl::ResponseHandler* WriteBehind::Report(XrdCl::ResponseHandler* handler) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (error.IsOK())
+        return handler;
+    ReportHandler* report = new ReportHandler(handler, error);
+    error = XRootDStatus();
+    return report;
+}
+}
@@ -0,0 +1,95 @@
+/********************************************************************************
+ *    Copyright (C) 2014 GSI Helmholtzzentrum fuer Schwerionenforschung GmbH *
+ *                                                                              *
+ *              This software is distributed under the terms of the *
+ *         GNU Lesser General Public Licence version 3 (LGPL) version 3, *
+ *                  copied verbatim in the file "LICENSE" *
+ ********************************************************************************/
+#ifndef __XRDPROXYPREFIX_WRITEBEHIND_HH___
+#define __XRDPROXYPREFIX_WRITEBEHIND_HH___
+#include "XrdCl/XrdClFile.hh"
+#include <condition_variable>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace ProxyPrefix {
+//----------------------------------------------------------------------------
+// Write-behind for a single file: contiguous writes are copied into a
+// buffer and acknowledged right away, the buffer goes out as one write
+// once it is full, on a write elsewhere in the file and on Flush. Writes of
+// at least a chunk skip the buffer. A bounded number of buffered writes is
+// kept in flight, no write overtakes one in flight that covers the same
+// bytes. The first one that fails is reported
+// once, to the next Write, Sync or Close.
+//
+// Write waits while the window is full and Flush until the writes are
+// acknowledged, both block the calling thread.
+//----------------------------------------------------------------------------
+class WriteBehind {
+  public:
+    //------------------------------------------------------------------------
+    // Constructor, the file has to outlive the write-behind
+    //------------------------------------------------------------------------
+    WriteBehind(XrdCl::File* file);
+
+    //------------------------------------------------------------------------
+    // Destructor, waits for the outstanding writes
+    //------------------------------------------------------------------------
+    ~WriteBehind();
+
+    //------------------------------------------------------------------------
+    // Size of the buffer and maximum number of writes in flight, a size of
+    // 0 disables
+    //------------------------------------------------------------------------
+    static void setLimits(uint32_t chunkSize, uint32_t maxInFlight);
+
+    static bool enabled() { return chunkSize != 0; }
+
+    void SetFile(XrdCl::File* f) { file = f; }
+
+    XrdCl::XRootDStatus Write(uint64_t offset, uint32_t size, const void* buffer,
+                              XrdCl::ResponseHandler* handler, uint16_t timeout);
+
+    //------------------------------------------------------------------------
+    // Send the buffer and wait until all writes are acknowledged
+    //------------------------------------------------------------------------
+    void Flush();
+
+    //------------------------------------------------------------------------
+    // Wrap the handler of a Sync or Close so it gets the error of an
+    // earlier write instead of a success, the error is cleared
+    //------------------------------------------------------------------------
+    XrdCl::ResponseHandler* Report(XrdCl::ResponseHandler* handler);
+
+  private:
+    class ChunkHandler;
+    class PassHandler;
+    class ReportHandler;
+
+    static uint32_t chunkSize;
+    static uint32_t maxInFlight;
+
+    typedef std::pair<uint64_t, uint64_t> Range; //< offset and end of a chunk
+
+    // writeMtx held, waits for the window and for overlapping chunks
+    XrdCl::XRootDStatus Send(uint64_t offset, std::vector<char>& data);
+    // a status of 0 ends the chunk without recording an error
+    void OnChunk(const Range& range, XrdCl::XRootDStatus* status);
+    // mtx held
+    bool Overlaps(const Range& range) const;
+    void Remove(const Range& range);
+
+    XrdCl::File* file;
+    std::mutex writeMtx; //< serializes Write and Flush, guards the buffer
+    std::vector<char> buffer;
+    uint64_t bufferOffset;
+    std::mutex mtx; //< guards the chunks in flight and the error
+    std::condition_variable cond;
+    std::vector<Range> chunks;
+    uint16_t lastTimeout;
+    XrdCl::XRootDStatus error;
+};
+}
+
+#endif // __XRDPROXYPREFIX_WRITEBEHIND_HH___
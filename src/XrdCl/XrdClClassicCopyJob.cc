@@ -32,17 +32,37 @@
 #include "XrdCl/XrdClCheckSumManager.hh"
 #include "XrdCks/XrdCksCalc.hh"
 #include "XrdCl/XrdClUglyHacks.hh"
+#include "XrdSys/XrdSysPthread.hh"
 
 #include <memory>
 #include <iostream>
 #include <queue>
+#include <vector>
 #include <algorithm>
+#include <cstdlib>
+#include <cstring>
 
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <unistd.h>
+#include <sys/uio.h>
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#ifdef __NR_io_uring_setup
+#define XRDCL_HAVE_IO_URING 1
+#endif
+#endif
+#endif
 
 namespace
 {
@@ -161,6 +181,332 @@ namespace
       XrdCksCalc  *pCksCalcObj;
   };
 
+  //----------------------------------------------------------------------------
+  //! Chunk buffers shared by the source and the destination of a job. The
+  //! source takes a buffer for every chunk it reads and the destination gives
+  //! it back once the chunk is written, so after the first few chunks the
+  //! copy runs on recycled memory instead of allocating and faulting in a
+  //! fresh chunk each time.
+  //----------------------------------------------------------------------------
+  class ChunkBufferPool
+  {
+    public:
+      //------------------------------------------------------------------------
+      //! Constructor
+      //!
+      //! @param chunkSize  size of every buffer
+      //! @param maxBuffers number of released buffers kept for reuse
+      //------------------------------------------------------------------------
+      ChunkBufferPool( uint32_t chunkSize, size_t maxBuffers ):
+        pChunkSize( chunkSize ), pMaxBuffers( maxBuffers )
+      {
+        long pageSize = sysconf( _SC_PAGESIZE );
+        pAlignment = pageSize > 0 ? pageSize : 4096;
+      }
+
+      //------------------------------------------------------------------------
+      //! Destructor
+      //------------------------------------------------------------------------
+      ~ChunkBufferPool()
+      {
+        for( size_t i = 0; i < pFree.size(); ++i )
+          free( pFree[i] );
+      }
+
+      //------------------------------------------------------------------------
+      //! Get a buffer of chunkSize bytes, 0 if there is no memory
+      //------------------------------------------------------------------------
+      char *Get()
+      {
+        {
+          XrdSysMutexHelper scopedLock( pMutex );
+          if( !pFree.empty() )
+          {
+            char *buffer = pFree.back();
+            pFree.pop_back();
+            return buffer;
+          }
+        }
+
+        //----------------------------------------------------------------------
+        // Page aligned and touched once, so that the page faults are taken
+        // here and not on every chunk
+        //----------------------------------------------------------------------
+        void *buffer = 0;
+        if( posix_memalign( &buffer, pAlignment, pChunkSize ) != 0 )
+          return 0;
+        memset( buffer, 0, pChunkSize );
+        return (char*)buffer;
+      }
+
+      //------------------------------------------------------------------------
+      //! Give a buffer back, 0 is ignored
+      //------------------------------------------------------------------------
+      void Put( void *buffer )
+      {
+        if( !buffer )
+          return;
+        XrdSysMutexHelper scopedLock( pMutex );
+        if( pFree.size() < pMaxBuffers )
+          pFree.push_back( (char*)buffer );
+        else
+          free( buffer );
+      }
+
+    private:
+      ChunkBufferPool(const ChunkBufferPool &other);
+      ChunkBufferPool &operator = (const ChunkBufferPool &other);
+
+      uint32_t            pChunkSize;
+      size_t              pMaxBuffers;
+      size_t              pAlignment;
+      XrdSysMutex         pMutex;
+      std::vector<char *> pFree;
+  };
+
+  //----------------------------------------------------------------------------
+  //! A minimal io_uring for the local files of a copy, driven through the
+  //! system calls. The reads and writes of the next chunks wait in the kernel
+  //! while the copy thread talks to the network, so the disk and the network
+  //! are busy at the same time. Initialize fails where the kernel has no
+  //! io_uring or does not allow it, the files are then accessed with blocking
+  //! calls.
+  //----------------------------------------------------------------------------
+  class IORing
+  {
+    public:
+      enum Operation
+      {
+        Read,
+        Write
+      };
+
+      //------------------------------------------------------------------------
+      //! Constructor
+      //------------------------------------------------------------------------
+      IORing(): pFD( -1 )
+#ifdef XRDCL_HAVE_IO_URING
+        , pSQRing( 0 ), pSQRingSize( 0 ), pCQRing( 0 ), pCQRingSize( 0 ),
+        pSQEs( 0 ), pSQEsSize( 0 )
+#endif
+      {
+      }
+
+      //------------------------------------------------------------------------
+      //! Destructor, all the requests must have been completed
+      //------------------------------------------------------------------------
+      ~IORing()
+      {
+#ifdef XRDCL_HAVE_IO_URING
+        if( pSQEs )
+          munmap( pSQEs, pSQEsSize );
+        if( pCQRing )
+          munmap( pCQRing, pCQRingSize );
+        if( pSQRing )
+          munmap( pSQRing, pSQRingSize );
+#endif
+        if( pFD != -1 )
+          close( pFD );
+      }
+
+      //------------------------------------------------------------------------
+      //! Set up the ring
+      //!
+      //! @param entries maximum number of requests in flight
+      //! @return        false if io_uring cannot be used
+      //------------------------------------------------------------------------
+      bool Initialize( uint32_t entries )
+      {
+#ifdef XRDCL_HAVE_IO_URING
+        io_uring_params params;
+        memset( &params, 0, sizeof( params ) );
+        int fd = syscall( __NR_io_uring_setup, entries, &params );
+        if( fd < 0 )
+          return false;
+        pFD = fd;
+
+        pSQRingSize = params.sq_off.array +
+                      params.sq_entries * sizeof( uint32_t );
+        pCQRingSize = params.cq_off.cqes +
+                      params.cq_entries * sizeof( io_uring_cqe );
+        pSQEsSize   = params.sq_entries * sizeof( io_uring_sqe );
+        pSQRing = Map( pSQRingSize, IORING_OFF_SQ_RING );
+        pCQRing = Map( pCQRingSize, IORING_OFF_CQ_RING );
+        pSQEs   = (io_uring_sqe*)Map( pSQEsSize, IORING_OFF_SQES );
+        if( !pSQRing || !pCQRing || !pSQEs )
+          return false;
+
+        char *sq = (char*)pSQRing;
+        pSQTail  = (uint32_t*)( sq + params.sq_off.tail );
+        pSQMask  = *(uint32_t*)( sq + params.sq_off.ring_mask );
+        pSQArray = (uint32_t*)( sq + params.sq_off.array );
+        char *cq = (char*)pCQRing;
+        pCQHead  = (uint32_t*)( cq + params.cq_off.head );
+        pCQTail  = (uint32_t*)( cq + params.cq_off.tail );
+        pCQMask  = *(uint32_t*)( cq + params.cq_off.ring_mask );
+        pCQEs    = (io_uring_cqe*)( cq + params.cq_off.cqes );
+        return true;
+#else
+        (void)entries;
+        return false;
+#endif
+      }
+
+      //------------------------------------------------------------------------
+      //! Submit a read or a write, the iovec has to stay valid until the
+      //! completion
+      //!
+      //! @param data returned by Wait() for the completion of this request
+      //! @return     0 or the errno of the submission
+      //------------------------------------------------------------------------
+      int Submit( Operation op, int fd, iovec *iov, uint64_t offset,
+                  void *data )
+      {
+#ifdef XRDCL_HAVE_IO_URING
+        uint32_t      tail  = *pSQTail;
+        uint32_t      index = tail & pSQMask;
+        io_uring_sqe *sqe   = &pSQEs[index];
+        memset( sqe, 0, sizeof( io_uring_sqe ) );
+        sqe->opcode    = op == Read ? IORING_OP_READV : IORING_OP_WRITEV;
+        sqe->fd        = fd;
+        sqe->addr      = (uintptr_t)iov;
+        sqe->len       = 1;
+        sqe->off       = offset;
+        sqe->user_data = (uintptr_t)data;
+        pSQArray[index] = index;
+        __atomic_store_n( pSQTail, tail + 1, __ATOMIC_RELEASE );
+
+        while( syscall( __NR_io_uring_enter, pFD, 1, 0, 0, 0, 0 ) < 0 )
+        {
+          if( errno == EINTR )
+            continue;
+          //--------------------------------------------------------------------
+          // The entry stays in the ring and would be picked up by the next
+          // call, it must not touch the buffer of the caller any more
+          //--------------------------------------------------------------------
+          int error = errno;
+          memset( sqe, 0, sizeof( io_uring_sqe ) );
+          sqe->opcode = IORING_OP_NOP;
+          return error;
+        }
+        return 0;
+#else
+        (void)op; (void)fd; (void)iov; (void)offset; (void)data;
+        return ENOSYS;
+#endif
+      }
+
+      //------------------------------------------------------------------------
+      //! Wait for the next completion
+      //!
+      //! @param data   as given to Submit()
+      //! @param result number of bytes transfered or -errno
+      //! @return       0 or the errno of the wait
+      //------------------------------------------------------------------------
+      int Wait( void *&data, int32_t &result )
+      {
+#ifdef XRDCL_HAVE_IO_URING
+        while( 1 )
+        {
+          uint32_t head = *pCQHead;
+          if( head != __atomic_load_n( pCQTail, __ATOMIC_ACQUIRE ) )
+          {
+            io_uring_cqe *cqe = &pCQEs[head & pCQMask];
+            data   = (void*)(uintptr_t)cqe->user_data;
+            result = cqe->res;
+            __atomic_store_n( pCQHead, head + 1, __ATOMIC_RELEASE );
+            if( data )
+              return 0;
+            continue;
+          }
+
+          if( syscall( __NR_io_uring_enter, pFD, 0, 1,
+                       IORING_ENTER_GETEVENTS, 0, 0 ) < 0 && errno != EINTR )
+            return errno;
+        }
+#else
+        (void)data; (void)result;
+        return ENOSYS;
+#endif
+      }
+
+    private:
+      IORing(const IORing &other);
+      IORing &operator = (const IORing &other);
+
+      int pFD;
+#ifdef XRDCL_HAVE_IO_URING
+      void *Map( size_t size, off_t offset )
+      {
+        void *ptr = mmap( 0, size, PROT_READ|PROT_WRITE,
+                          MAP_SHARED|MAP_POPULATE, pFD, offset );
+        return ptr == MAP_FAILED ? 0 : ptr;
+      }
+
+      void         *pSQRing;
+      size_t        pSQRingSize;
+      void         *pCQRing;
+      size_t        pCQRingSize;
+      io_uring_sqe *pSQEs;
+      size_t        pSQEsSize;
+      uint32_t     *pSQTail;
+      uint32_t      pSQMask;
+      uint32_t     *pSQArray;
+      uint32_t     *pCQHead;
+      uint32_t     *pCQTail;
+      uint32_t      pCQMask;
+      io_uring_cqe *pCQEs;
+#endif
+  };
+
+  //----------------------------------------------------------------------------
+  //! Alignment of the offsets and lengths of the requests made with O_DIRECT
+  //----------------------------------------------------------------------------
+  const uint64_t DirectIOAlignment = 4096;
+
+  //----------------------------------------------------------------------------
+  //! Open a local file, with O_DIRECT if asked for and the chunks are aligned.
+  //! File systems without O_DIRECT get the file opened without it.
+  //----------------------------------------------------------------------------
+  int OpenLocal( const std::string &path, int flags, uint32_t chunkSize,
+                 bool &direct, mode_t mode = 0 )
+  {
+    direct = direct && chunkSize % DirectIOAlignment == 0;
+    if( direct )
+    {
+      int fd = open( path.c_str(), flags | O_DIRECT, mode );
+      if( fd != -1 || errno != EINVAL )
+        return fd;
+      direct = false;
+    }
+    return open( path.c_str(), flags, mode );
+  }
+
+  //----------------------------------------------------------------------------
+  //! Switch a file opened with O_DIRECT to the page cache before a request
+  //! that is not aligned, usually the tail of the file
+  //----------------------------------------------------------------------------
+  void DropDirectIO( int fd, bool &direct, uint64_t offset, uint64_t length )
+  {
+    if( !direct || ( offset % DirectIOAlignment == 0 &&
+                     length % DirectIOAlignment == 0 ) )
+      return;
+    int flags = fcntl( fd, F_GETFL );
+    if( flags != -1 )
+      fcntl( fd, F_SETFL, flags & ~O_DIRECT );
+    direct = false;
+  }
+
+  //----------------------------------------------------------------------------
+  //! Errors of copy_file_range and sendfile meaning that the kernel cannot
+  //! copy between these two files
+  //----------------------------------------------------------------------------
+  bool KernelCopyUnsupported( int error )
+  {
+    return error == ENOSYS || error == EINVAL || error == EXDEV ||
+           error == EOPNOTSUPP || error == EBADF;
+  }
+
   //----------------------------------------------------------------------------
   //! Abstract chunk source
   //----------------------------------------------------------------------------
@@ -185,7 +531,8 @@ namespace
       //------------------------------------------------------------------------
       //! Get a data chunk from the source
       //!
-      //! @param  ci     chunk information
+      //! @param  ci     chunk information, a chunk without a buffer is a hole
+      //!                of a sparse file and reads as zeros
       //! @return        status of the operation
       //!                suContinue - there are some chunks left
       //!                suDone     - no chunks left
@@ -229,7 +576,7 @@ namespace
       //------------------------------------------------------------------------
       //! Put a data chunk at a destination
       //!
-      //! @param  ci     chunk information
+      //! @param  ci     chunk information, without a buffer for a hole
       //! @return status of the operation
       //------------------------------------------------------------------------
       virtual XrdCl::XRootDStatus PutChunk( XrdCl::ChunkInfo &ci ) = 0;
@@ -292,11 +639,20 @@ namespace
     public:
       //------------------------------------------------------------------------
       //! Constructor
+      //!
+      //! @param parallelChunks reads kept in flight when io_uring is available
+      //! @param directIO       bypass the page cache with O_DIRECT
+      //! @param sparse         hand out the holes of the file as chunks
+      //!                       without a buffer instead of reading them
       //------------------------------------------------------------------------
       LocalSource( const XrdCl::URL *url, const std::string &ckSumType,
-                   uint32_t chunkSize ):
+                   uint32_t chunkSize, uint8_t parallelChunks, bool directIO,
+                   bool sparse, ChunkBufferPool *pool ):
         pPath( url->GetPath() ), pFD( -1 ), pSize( -1 ), pCurrentOffset( 0 ),
-        pCkSumHelper(0), pChunkSize( chunkSize )
+        pIssueOffset( 0 ), pCkSumHelper(0), pChunkSize( chunkSize ),
+        pParallel( std::max<uint8_t>( parallelChunks, 1 ) ),
+        pDirect( directIO ), pSparse( sparse ), pCopyFileRange( true ),
+        pPool( pool ), pRing( 0 )
       {
         if( !ckSumType.empty() )
           pCkSumHelper = new CheckSumHelper( url->GetPath(), ckSumType );
@@ -307,8 +663,10 @@ namespace
       //------------------------------------------------------------------------
       virtual ~LocalSource()
       {
+        CleanUpChunks();
         if( pFD != -1 )
           close( pFD );
+        delete pRing;
         delete pCkSumHelper;
       }
 
@@ -332,7 +690,7 @@ namespace
         //----------------------------------------------------------------------
         log->Debug( UtilityMsg, "Opening %s for reading", pPath.c_str() );
 
-        int fd = open( pPath.c_str(), O_RDONLY );
+        int fd = OpenLocal( pPath, O_RDONLY, pChunkSize, pDirect );
         if( fd == -1 )
         {
           log->Debug( UtilityMsg, "Unable to open %s: %s",
@@ -351,6 +709,20 @@ namespace
         pFD   = fd;
         pSize = st.st_size;
 
+        //----------------------------------------------------------------------
+        // Only files with fewer blocks than their size can have holes
+        //----------------------------------------------------------------------
+        pSparse = pSparse && int64_t( st.st_blocks ) * 512 < pSize;
+
+        pRing = new IORing();
+        if( !pRing->Initialize( pParallel ) )
+        {
+          log->Debug( UtilityMsg, "io_uring not available, reading %s with "
+                      "blocking calls", pPath.c_str() );
+          delete pRing;
+          pRing = 0;
+        }
+
         return XRootDStatus();
       }
 
@@ -368,28 +740,63 @@ namespace
       virtual XrdCl::XRootDStatus GetChunk( XrdCl::ChunkInfo &ci )
       {
         using namespace XrdCl;
-        Log *log = DefaultEnv::GetLog();
 
         if( pFD == -1 )
           return XRootDStatus( stError, errUninitialized );
 
-        const uint32_t toRead = pChunkSize;
-        char *buffer = new char[toRead];
+        //----------------------------------------------------------------------
+        // Keep the reads of the next chunks in flight, whatever is found
+        // behind the size seen at open is read with blocking calls below
+        //----------------------------------------------------------------------
+        while( pRing && pChunks.size() < pParallel && pIssueOffset < pSize )
+        {
+          uint32_t length;
+          if( FindHole( pIssueOffset, length ) )
+          {
+            pChunks.push( new ReadRequest( 0, length, pIssueOffset ) );
+            pIssueOffset += length;
+            continue;
+          }
+
+          char *buffer = pPool->Get();
+          if( !buffer )
+            break;
+          ReadRequest *rq = new ReadRequest( buffer, length, pIssueOffset );
+          int error = pRing->Submit( IORing::Read, pFD, &rq->iov, rq->offset,
+                                     rq );
+          if( error )
+          {
+            pPool->Put( buffer );
+            delete rq;
+            return ReadError( error );
+          }
+          pChunks.push( rq );
+          pIssueOffset += length;
+        }
+
+        if( !pChunks.empty() )
+          return GetQueuedChunk( ci );
+
+        uint32_t toRead;
+        if( FindHole( pCurrentOffset, toRead ) )
+          return GetHole( ci, toRead );
+
+        char *buffer = pPool->Get();
+        if( !buffer )
+          return XRootDStatus( stError, errOSError, ENOMEM );
 
-        int64_t bytesRead = read( pFD, buffer, toRead );
+        DropDirectIO( pFD, pDirect, pCurrentOffset, toRead );
+        int64_t bytesRead = pread( pFD, buffer, toRead, pCurrentOffset );
         if( bytesRead == -1 )
         {
-          log->Debug( UtilityMsg, "Unable to read from %s: %s",
-                                  pPath.c_str(), strerror( errno ) );
-          close( pFD );
-          pFD = -1;
-          delete [] buffer;
-          return XRootDStatus( stError, errOSError, errno );
+          int error = errno;
+          pPool->Put( buffer );
+          return ReadError( error );
         }
 
         if( bytesRead == 0 )
         {
-          delete [] buffer;
+          pPool->Put( buffer );
           return XRootDStatus( stOK, suDone );
         }
 
@@ -403,6 +810,120 @@ namespace
         return XRootDStatus( stOK, suContinue );
       }
 
+      //------------------------------------------------------------------------
+      //! Copy the next chunk into a local file at the same offset without
+      //! passing it through user space: with copy_file_range, which shares
+      //! the blocks on file systems supporting reflinks, or with sendfile.
+      //! The data is only read back if a check sum is needed.
+      //!
+      //! @param  fd destination file
+      //! @param  ci offset and length of the chunk, no buffer
+      //! @return    status of the operation
+      //!            suContinue      - there are some chunks left
+      //!            suDone          - no chunks left
+      //!            errNotSupported - the kernel cannot copy between the
+      //!                              files, nothing was copied
+      //!            errOSError      - the copy failed, this may be either
+      //!                              file and is left to the destination
+      //------------------------------------------------------------------------
+      XrdCl::XRootDStatus CopyChunk( int fd, XrdCl::ChunkInfo &ci )
+      {
+        using namespace XrdCl;
+        Log *log = DefaultEnv::GetLog();
+
+        if( pFD == -1 )
+          return XRootDStatus( stError, errUninitialized );
+
+        //----------------------------------------------------------------------
+        // A hole only extends the destination
+        //----------------------------------------------------------------------
+        uint32_t length;
+        if( FindHole( pCurrentOffset, length ) )
+        {
+          if( ftruncate( fd, pCurrentOffset + length ) == -1 )
+            return XRootDStatus( stError, errOSError, errno );
+          pIssueOffset = pCurrentOffset + length;
+          return GetHole( ci, length );
+        }
+
+#ifdef __linux__
+        ssize_t copied = -1;
+        int     error  = ENOSYS;
+#ifdef __NR_copy_file_range
+        if( pCopyFileRange )
+        {
+          loff_t in  = pCurrentOffset;
+          loff_t out = pCurrentOffset;
+          copied = syscall( __NR_copy_file_range, pFD, &in, fd, &out,
+                            size_t( length ), 0 );
+          if( copied == -1 )
+          {
+            error = errno;
+            pCopyFileRange = !KernelCopyUnsupported( error );
+          }
+        }
+#endif
+        if( copied == -1 && KernelCopyUnsupported( error ) )
+        {
+          off_t in = pCurrentOffset;
+          if( lseek( fd, pCurrentOffset, SEEK_SET ) == -1 )
+            error = errno;
+          else
+          {
+            copied = sendfile( fd, pFD, &in, length );
+            if( copied == -1 )
+              error = errno;
+          }
+        }
+
+        if( copied == -1 )
+        {
+          if( KernelCopyUnsupported( error ) )
+          {
+            log->Debug( UtilityMsg, "Unable to copy %s in the kernel: %s",
+                        pPath.c_str(), strerror( error ) );
+            return XRootDStatus( stError, errNotSupported, error );
+          }
+          return XRootDStatus( stError, errOSError, error );
+        }
+
+        if( copied == 0 )
+          return XRootDStatus( stOK, suDone );
+
+        if( pCkSumHelper )
+        {
+          char *buffer = pPool->Get();
+          if( !buffer )
+            return XRootDStatus( stError, errOSError, ENOMEM );
+          ssize_t done = 0;
+          while( done < copied )
+          {
+            DropDirectIO( pFD, pDirect, pCurrentOffset + done, copied - done );
+            ssize_t rd = pread( pFD, buffer + done, copied - done,
+                                pCurrentOffset + done );
+            if( rd <= 0 )
+            {
+              pPool->Put( buffer );
+              return ReadError( rd == 0 ? EIO : errno );
+            }
+            done += rd;
+          }
+          pCkSumHelper->Update( buffer, copied );
+          pPool->Put( buffer );
+        }
+
+        ci.offset = pCurrentOffset;
+        ci.length = copied;
+        ci.buffer = 0;
+        pCurrentOffset += copied;
+        pIssueOffset    = pCurrentOffset;
+        return XRootDStatus( stOK, suContinue );
+#else
+        (void)fd; (void)ci;
+        return XRootDStatus( stError, errNotSupported );
+#endif
+      }
+
       //------------------------------------------------------------------------
       //! Get check sum
       //------------------------------------------------------------------------
@@ -418,12 +939,214 @@ namespace
     private:
       LocalSource(const LocalSource &other);
       LocalSource &operator = (const LocalSource &other);
-      std::string     pPath;
-      int             pFD;
-      int64_t         pSize;
-      uint64_t        pCurrentOffset;
-      CheckSumHelper *pCkSumHelper;
-      uint32_t        pChunkSize;
+
+      //------------------------------------------------------------------------
+      // A read queued in the ring
+      //------------------------------------------------------------------------
+      struct ReadRequest
+      {
+        ReadRequest( char *buffer, uint32_t length, uint64_t off ):
+          offset( off ), result( buffer ? 0 : length ), done( !buffer )
+        {
+          iov.iov_base = buffer;
+          iov.iov_len  = length;
+        }
+
+        iovec    iov;
+        uint64_t offset;
+        int32_t  result;
+        bool     done;
+      };
+
+      //------------------------------------------------------------------------
+      // Wait for the oldest read and hand it out, a short read before the
+      // end of the file is completed with a blocking call
+      //------------------------------------------------------------------------
+      XrdCl::XRootDStatus GetQueuedChunk( XrdCl::ChunkInfo &ci )
+      {
+        using namespace XrdCl;
+        ReadRequest *rq = pChunks.front();
+        pChunks.pop();
+        int error = Reap( rq );
+        if( error )
+        {
+          delete rq;
+          return ReadError( error );
+        }
+
+        char    *buffer    = (char*)rq->iov.iov_base;
+        int64_t  length    = rq->iov.iov_len;
+        int64_t  bytesRead = rq->result;
+        if( !buffer )
+        {
+          delete rq;
+          return GetHole( ci, length );
+        }
+
+        while( bytesRead >= 0 && bytesRead < length &&
+               int64_t( rq->offset ) + bytesRead < pSize )
+        {
+          DropDirectIO( pFD, pDirect, rq->offset + bytesRead,
+                        length - bytesRead );
+          ssize_t rd = pread( pFD, buffer + bytesRead, length - bytesRead,
+                              rq->offset + bytesRead );
+          if( rd == 0 )
+            break;
+          bytesRead = rd < 0 ? -errno : bytesRead + rd;
+        }
+        delete rq;
+
+        if( bytesRead < 0 )
+        {
+          pPool->Put( buffer );
+          return ReadError( -bytesRead );
+        }
+
+        //----------------------------------------------------------------------
+        // The file got shorter, the reads behind this one are of no use
+        //----------------------------------------------------------------------
+        if( bytesRead < length )
+        {
+          CleanUpChunks();
+          pIssueOffset = std::max( pIssueOffset, pSize );
+        }
+
+        if( bytesRead == 0 )
+        {
+          pPool->Put( buffer );
+          return XRootDStatus( stOK, suDone );
+        }
+
+        if( pCkSumHelper )
+          pCkSumHelper->Update( buffer, bytesRead );
+
+        ci.offset = pCurrentOffset;
+        ci.length = bytesRead;
+        ci.buffer = buffer;
+        pCurrentOffset += bytesRead;
+        return XRootDStatus( stOK, suContinue );
+      }
+
+      //------------------------------------------------------------------------
+      // Check whether there is a hole at the offset. The length is the one
+      // of the hole or of the data up to the next hole, at most a chunk.
+      //------------------------------------------------------------------------
+      bool FindHole( int64_t offset, uint32_t &length )
+      {
+        length = pChunkSize;
+        if( !pSparse || offset >= pSize )
+          return false;
+
+        off_t data = lseek( pFD, offset, SEEK_DATA );
+        if( data == -1 && errno == ENXIO )
+          data = pSize;
+        else if( data == -1 )
+        {
+          pSparse = false;
+          return false;
+        }
+
+        if( data > offset )
+        {
+          length = std::min<int64_t>( data - offset, pChunkSize );
+          return true;
+        }
+
+        off_t hole = lseek( pFD, offset, SEEK_HOLE );
+        if( hole > offset )
+          length = std::min<int64_t>( hole - offset, pChunkSize );
+        return false;
+      }
+
+      //------------------------------------------------------------------------
+      // Hand out a hole, the check sum gets the zeros
+      //------------------------------------------------------------------------
+      XrdCl::XRootDStatus GetHole( XrdCl::ChunkInfo &ci, uint32_t length )
+      {
+        using namespace XrdCl;
+        if( pCkSumHelper )
+        {
+          char *zeros = pPool->Get();
+          if( !zeros )
+            return XRootDStatus( stError, errOSError, ENOMEM );
+          memset( zeros, 0, length );
+          pCkSumHelper->Update( zeros, length );
+          pPool->Put( zeros );
+        }
+
+        ci.offset = pCurrentOffset;
+        ci.length = length;
+        ci.buffer = 0;
+        pCurrentOffset += length;
+        return XRootDStatus( stOK, suContinue );
+      }
+
+      //------------------------------------------------------------------------
+      // Wait until the given read is done
+      //------------------------------------------------------------------------
+      int Reap( ReadRequest *rq )
+      {
+        while( !rq->done )
+        {
+          void    *data;
+          int32_t  result;
+          int error = pRing->Wait( data, result );
+          if( error )
+            return error;
+          ReadRequest *done = (ReadRequest*)data;
+          done->result = result;
+          done->done   = true;
+        }
+        return 0;
+      }
+
+      //------------------------------------------------------------------------
+      // Wait for the reads in flight and drop them
+      //------------------------------------------------------------------------
+      void CleanUpChunks()
+      {
+        while( !pChunks.empty() )
+        {
+          ReadRequest *rq = pChunks.front();
+          pChunks.pop();
+          //--------------------------------------------------------------------
+          // A buffer the kernel may still write to is not given back
+          //--------------------------------------------------------------------
+          if( Reap( rq ) == 0 )
+            pPool->Put( rq->iov.iov_base );
+          delete rq;
+        }
+      }
+
+      //------------------------------------------------------------------------
+      // Give up on the file after a failed read
+      //------------------------------------------------------------------------
+      XrdCl::XRootDStatus ReadError( int error )
+      {
+        using namespace XrdCl;
+        Log *log = DefaultEnv::GetLog();
+        log->Debug( UtilityMsg, "Unable to read from %s: %s",
+                                pPath.c_str(), strerror( error ) );
+        CleanUpChunks();
+        close( pFD );
+        pFD = -1;
+        return XRootDStatus( stError, errOSError, error );
+      }
+
+      std::string                pPath;
+      int                        pFD;
+      int64_t                    pSize;
+      int64_t                    pCurrentOffset;
+      int64_t                    pIssueOffset;
+      CheckSumHelper            *pCkSumHelper;
+      uint32_t                   pChunkSize;
+      uint8_t                    pParallel;
+      bool                       pDirect;
+      bool                       pSparse;
+      bool                       pCopyFileRange;
+      ChunkBufferPool           *pPool;
+      IORing                    *pRing;
+      std::queue<ReadRequest *>  pChunks;
   };
 
   //----------------------------------------------------------------------------
@@ -435,8 +1158,10 @@ namespace
       //------------------------------------------------------------------------
       //! Constructor
       //------------------------------------------------------------------------
-      StdInSource( const std::string &ckSumType, uint32_t chunkSize ):
-        pCkSumHelper(0), pCurrentOffset(0), pChunkSize( chunkSize )
+      StdInSource( const std::string &ckSumType, uint32_t chunkSize,
+                   ChunkBufferPool *pool ):
+        pCkSumHelper(0), pCurrentOffset(0), pChunkSize( chunkSize ),
+        pPool( pool )
       {
         if( !ckSumType.empty() )
           pCkSumHelper = new CheckSumHelper( "stdin", ckSumType );
@@ -477,7 +1202,9 @@ namespace
         Log *log = DefaultEnv::GetLog();
 
         uint32_t toRead = pChunkSize;
-        char *buffer = new char[toRead];
+        char *buffer = pPool->Get();
+        if( !buffer )
+          return XRootDStatus( stError, errOSError, ENOMEM );
 
         int64_t  bytesRead = 0;
         uint32_t offset    = 0;
@@ -488,7 +1215,7 @@ namespace
           {
             log->Debug( UtilityMsg, "Unable to read from stdin: %s",
                         strerror( errno ) );
-            delete [] buffer;
+            pPool->Put( buffer );
             return XRootDStatus( stError, errOSError, errno );
           }
 
@@ -502,7 +1229,7 @@ namespace
 
         if( bytesRead == 0 )
         {
-          delete [] buffer;
+          pPool->Put( buffer );
           return XRootDStatus( stOK, suDone );
         }
 
@@ -532,9 +1259,10 @@ namespace
       StdInSource(const StdInSource &other);
       StdInSource &operator = (const StdInSource &other);
 
-      CheckSumHelper *pCkSumHelper;
-      uint64_t        pCurrentOffset;
-      uint32_t        pChunkSize;
+      CheckSumHelper  *pCkSumHelper;
+      uint64_t         pCurrentOffset;
+      uint32_t         pChunkSize;
+      ChunkBufferPool *pPool;
   };
 
   //----------------------------------------------------------------------------
@@ -548,10 +1276,11 @@ namespace
       //------------------------------------------------------------------------
       XRootDSource( const XrdCl::URL *url,
                     uint32_t          chunkSize,
-                    uint8_t           parallelChunks ):
+                    uint8_t           parallelChunks,
+                    ChunkBufferPool  *pool ):
         pUrl( url ), pFile( new XrdCl::File() ), pSize( -1 ),
         pCurrentOffset( 0 ), pChunkSize( chunkSize ),
-        pParallel( parallelChunks )
+        pParallel( parallelChunks ), pPool( pool )
       {
       }
 
@@ -631,7 +1360,13 @@ namespace
           if( pCurrentOffset + chunkSize > (uint64_t)pSize )
             chunkSize = pSize - pCurrentOffset;
 
-          char *buffer = new char[chunkSize];
+          char *buffer = pPool->Get();
+          if( !buffer )
+          {
+            if( pChunks.empty() )
+              return XRootDStatus( stError, errOSError, ENOMEM );
+            break;
+          }
           ChunkHandler *ch = new ChunkHandler;
           ch->chunk.offset = pCurrentOffset;
           ch->chunk.length = chunkSize;
@@ -661,7 +1396,7 @@ namespace
           log->Debug( UtilityMsg, "Unable read %d bytes at %ld from %s: %s",
                       ch->chunk.length, ch->chunk.offset,
                       pUrl->GetURL().c_str(), ch->status.ToStr().c_str() );
-          delete [] (char *)ch->chunk.buffer;
+          pPool->Put( ch->chunk.buffer );
           CleanUpChunks();
           return ch->status;
         }
@@ -680,7 +1415,7 @@ namespace
           ChunkHandler *ch = pChunks.front();
           pChunks.pop();
           ch->sem->Wait();
-          delete [] (char *)ch->chunk.buffer;
+          pPool->Put( ch->chunk.buffer );
           delete ch;
         }
       }
@@ -734,6 +1469,7 @@ namespace
       int64_t                     pCurrentOffset;
       uint32_t                    pChunkSize;
       uint8_t                     pParallel;
+      ChunkBufferPool            *pPool;
       std::queue<ChunkHandler *>  pChunks;
   };
 
@@ -745,11 +1481,18 @@ namespace
     public:
       //------------------------------------------------------------------------
       //! Constructor
+      //!
+      //! @param parallelChunks reads kept in flight, 1 reads one chunk at a
+      //!                       time
       //------------------------------------------------------------------------
       XRootDSourceDynamic( const XrdCl::URL *url,
-                           uint32_t          chunkSize ):
+                           uint32_t          chunkSize,
+                           uint8_t           parallelChunks,
+                           ChunkBufferPool  *pool ):
         pUrl( url ), pFile( new XrdCl::File() ), pCurrentOffset( 0 ),
-        pChunkSize( chunkSize ), pDone( false )
+        pIssueOffset( 0 ), pChunkSize( chunkSize ),
+        pParallel( std::max<uint8_t>( parallelChunks, 1 ) ), pDone( false ),
+        pPool( pool )
       {
       }
 
@@ -758,6 +1501,7 @@ namespace
       //------------------------------------------------------------------------
       virtual ~XRootDSourceDynamic()
       {
+        CleanUpChunks();
         XrdCl::XRootDStatus status = pFile->Close();
         delete pFile;
       }
@@ -794,6 +1538,12 @@ namespace
       //------------------------------------------------------------------------
       //! Get a data chunk from the source
       //!
+      //! The file may still be growing, the first chunk that comes back short
+      //! ends the copy just like for a single read at a time. Reads issued
+      //! behind another one are speculative: they saw the file before the
+      //! reads in front of them completed, so a short or failed one is not
+      //! trusted but the rest of its chunk read again once it is in front.
+      //!
       //! @param  buffer buffer for the data
       //! @param  ci     chunk information
       //! @return        status of the operation
@@ -806,6 +1556,7 @@ namespace
         // Sanity check
         //----------------------------------------------------------------------
         using namespace XrdCl;
+        Log *log = DefaultEnv::GetLog();
 
         if( !pFile->IsOpen() )
           return XRootDStatus( stError, errUninitialized );
@@ -816,36 +1567,104 @@ namespace
         //----------------------------------------------------------------------
         // Fill the queue
         //----------------------------------------------------------------------
-        char     *buffer = new char[pChunkSize];
-        uint32_t  bytesRead = 0;
+        while( pChunks.size() < pParallel )
+        {
+          char *buffer = pPool->Get();
+          if( !buffer )
+          {
+            if( pChunks.empty() )
+              return XRootDStatus( stError, errOSError, ENOMEM );
+            break;
+          }
+          ChunkHandler *ch = new ChunkHandler( !pChunks.empty() );
+          ch->chunk.offset = pIssueOffset;
+          ch->chunk.length = pChunkSize;
+          ch->chunk.buffer = buffer;
+          ch->status = pFile->Read( pIssueOffset, pChunkSize, buffer, ch );
+          pChunks.push( ch );
+          pIssueOffset += pChunkSize;
+          if( !ch->status.IsOK() )
+          {
+            ch->sem->Post();
+            break;
+          }
+        }
 
-        XRootDStatus st = pFile->Read( pCurrentOffset, pChunkSize, buffer,
-                                       bytesRead );
+        //----------------------------------------------------------------------
+        // Pick up a chunk from the front and wait for status
+        //----------------------------------------------------------------------
+        XRDCL_SMART_PTR_T<ChunkHandler> ch( pChunks.front() );
+        pChunks.pop();
+        ch->sem->Wait();
 
-        if( !st.IsOK() )
+        //----------------------------------------------------------------------
+        // A speculative read that failed or came back short: everything
+        // behind it is dropped and the missing part read again, now that it
+        // is the only read in flight
+        //----------------------------------------------------------------------
+        bool complete = ch->status.IsOK() && ch->chunk.length == pChunkSize;
+        if( ch->speculative && !complete )
         {
-          delete [] buffer;
-          return st;
+          CleanUpChunks();
+          uint32_t have      = ch->status.IsOK() ? ch->chunk.length : 0;
+          uint32_t bytesRead = 0;
+          log->Dump( UtilityMsg, "Reading %d bytes at %ld from %s again",
+                     pChunkSize - have, pCurrentOffset + have,
+                     pUrl->GetURL().c_str() );
+          ch->status = pFile->Read( pCurrentOffset + have, pChunkSize - have,
+                                    (char*)ch->chunk.buffer + have,
+                                    bytesRead );
+          ch->chunk.offset = pCurrentOffset;
+          ch->chunk.length = have + bytesRead;
+          pIssueOffset     = pCurrentOffset + pChunkSize;
         }
 
-        if( !bytesRead )
+        if( !ch->status.IsOK() )
         {
-          delete [] buffer;
-          return XRootDStatus( stOK, suDone );
+          log->Debug( UtilityMsg, "Unable read %d bytes at %ld from %s: %s",
+                      pChunkSize, pCurrentOffset,
+                      pUrl->GetURL().c_str(), ch->status.ToStr().c_str() );
+          pPool->Put( ch->chunk.buffer );
+          CleanUpChunks();
+          return ch->status;
         }
 
-        if( bytesRead < pChunkSize )
+        //----------------------------------------------------------------------
+        // Short read: we are at the end of the file, the reads behind this one
+        // are past it
+        //----------------------------------------------------------------------
+        if( ch->chunk.length < pChunkSize )
+        {
           pDone = true;
+          CleanUpChunks();
+        }
 
-        ci.offset = pCurrentOffset;
-        ci.length = bytesRead;
-        ci.buffer = buffer;
-
-        pCurrentOffset += bytesRead;
+        if( !ch->chunk.length )
+        {
+          pPool->Put( ch->chunk.buffer );
+          return XRootDStatus( stOK, suDone );
+        }
 
+        ci = ch->chunk;
+        pCurrentOffset += ci.length;
         return XRootDStatus( stOK, suContinue );
       }
 
+      //------------------------------------------------------------------------
+      // Clean up the chunks that are flying
+      //------------------------------------------------------------------------
+      void CleanUpChunks()
+      {
+        while( !pChunks.empty() )
+        {
+          ChunkHandler *ch = pChunks.front();
+          pChunks.pop();
+          ch->sem->Wait();
+          pPool->Put( ch->chunk.buffer );
+          delete ch;
+        }
+      }
+
       //------------------------------------------------------------------------
       // Get check sum
       //------------------------------------------------------------------------
@@ -860,11 +1679,47 @@ namespace
     private:
       XRootDSourceDynamic(const XRootDSourceDynamic &other);
       XRootDSourceDynamic &operator = (const XRootDSourceDynamic &other);
+
+      //------------------------------------------------------------------------
+      // Asynchronous chunk handler
+      //------------------------------------------------------------------------
+      class ChunkHandler: public XrdCl::ResponseHandler
+      {
+        public:
+          ChunkHandler( bool spec ):
+            sem( new XrdCl::Semaphore(0) ), speculative( spec ) {}
+          virtual ~ChunkHandler() { delete sem; }
+          virtual void HandleResponse( XrdCl::XRootDStatus *statusval,
+                                       XrdCl::AnyObject    *response )
+          {
+            this->status = *statusval;
+            delete statusval;
+            if( response )
+            {
+              XrdCl::ChunkInfo *resp = 0;
+              response->Get( resp );
+              if( resp )
+                chunk = *resp;
+              delete response;
+            }
+            sem->Post();
+          }
+
+        XrdCl::Semaphore    *sem;
+        XrdCl::ChunkInfo     chunk;
+        XrdCl::XRootDStatus  status;
+        bool                 speculative;
+      };
+
       const XrdCl::URL           *pUrl;
       XrdCl::File                *pFile;
       int64_t                     pCurrentOffset;
+      int64_t                     pIssueOffset;
       uint32_t                    pChunkSize;
+      uint8_t                     pParallel;
       bool                        pDone;
+      ChunkBufferPool            *pPool;
+      std::queue<ChunkHandler *>  pChunks;
   };
 
   //----------------------------------------------------------------------------
@@ -875,9 +1730,16 @@ namespace
     public:
       //------------------------------------------------------------------------
       //! Constructor
-      //------------------------------------------------------------------------
-      LocalDestination( const XrdCl::URL *url ):
-        pPath( url->GetPath() ), pFD( -1 )
+      //!
+      //! @param parallelChunks writes kept in flight when io_uring is available
+      //! @param directIO       bypass the page cache with O_DIRECT
+      //------------------------------------------------------------------------
+      LocalDestination( const XrdCl::URL *url, uint32_t chunkSize,
+                        uint8_t parallelChunks, bool directIO,
+                        ChunkBufferPool *pool ):
+        pPath( url->GetPath() ), pFD( -1 ), pChunkSize( chunkSize ),
+        pParallel( std::max<uint8_t>( parallelChunks, 1 ) ), pInFlight( 0 ),
+        pDirect( directIO ), pPool( pool ), pRing( 0 )
       {
       }
 
@@ -888,6 +1750,7 @@ namespace
       {
         if( pFD != -1 )
           Finalize();
+        delete pRing;
       }
 
       //------------------------------------------------------------------------
@@ -918,7 +1781,7 @@ namespace
         if( !pForce )
           flags |= O_EXCL;
 
-        int fd = open( pPath.c_str(), flags, 0644 );
+        int fd = OpenLocal( pPath, flags, pChunkSize, pDirect, 0644 );
         if( fd == -1 )
         {
           log->Debug( UtilityMsg, "Unable to open %s: %s",
@@ -927,6 +1790,15 @@ namespace
         }
 
         pFD   = fd;
+
+        pRing = new IORing();
+        if( !pRing->Initialize( pParallel ) )
+        {
+          log->Debug( UtilityMsg, "io_uring not available, writing %s with "
+                      "blocking calls", pPath.c_str() );
+          delete pRing;
+          pRing = 0;
+        }
         return XRootDStatus();
       }
 
@@ -938,6 +1810,9 @@ namespace
         using namespace XrdCl;
         if( pFD != -1 )
         {
+          XRootDStatus st = Reap( 0 );
+          if( !st.IsOK() )
+            return WriteError( st );
           int fd = pFD; pFD = -1;
           if( close( fd ) != 0 )
             return XRootDStatus( stError, errOSError, errno );
@@ -960,31 +1835,52 @@ namespace
         if( pFD == -1 )
           return XRootDStatus( stError, errUninitialized );
 
-        int64_t   wr     = 0;
-        uint64_t  offset = ci.offset;
-        uint32_t  length = ci.length;
-        char     *cursor = (char*)ci.buffer;
-        do
+        //----------------------------------------------------------------------
+        // The file is new, so a hole only has to extend it
+        //----------------------------------------------------------------------
+        if( !ci.buffer )
         {
-          wr = pwrite( pFD, cursor, length, offset );
-          if( wr == -1 )
+          if( ftruncate( pFD, ci.offset + ci.length ) == -1 )
           {
-            log->Debug( UtilityMsg, "Unable to write to %s: %s", pPath.c_str(),
+            log->Debug( UtilityMsg, "Unable to extend %s: %s", pPath.c_str(),
                         strerror( errno ) );
-            close( pFD );
-            pFD = -1;
-            if( pPosc )
-              unlink( pPath.c_str() );
-            delete [] (char*)ci.buffer; ci.buffer = 0;
-            return XRootDStatus( stError, errOSError, errno );
+            return WriteError( XRootDStatus( stError, errOSError, errno ) );
           }
-          offset += wr;
-          cursor += wr;
-          length -= wr;
+          return XRootDStatus();
         }
-        while( length );
 
-        delete [] (char*)ci.buffer; ci.buffer = 0;
+        DropDirectIO( pFD, pDirect, ci.offset, ci.length );
+
+        //----------------------------------------------------------------------
+        // Queue the write and only wait once too many are in flight
+        //----------------------------------------------------------------------
+        if( pRing )
+        {
+          WriteRequest *rq = new WriteRequest( ci );
+          int error = pRing->Submit( IORing::Write, pFD, &rq->iov, ci.offset,
+                                     rq );
+          if( error )
+          {
+            delete rq;
+            pPool->Put( ci.buffer ); ci.buffer = 0;
+            return WriteError( XRootDStatus( stError, errOSError, error ) );
+          }
+          ci.buffer = 0;
+          ++pInFlight;
+          XRootDStatus st = Reap( pParallel - 1 );
+          if( !st.IsOK() )
+            return WriteError( st );
+          return XRootDStatus();
+        }
+
+        int error = WriteAll( (char*)ci.buffer, ci.length, ci.offset );
+        pPool->Put( ci.buffer ); ci.buffer = 0;
+        if( error )
+        {
+          log->Debug( UtilityMsg, "Unable to write to %s: %s", pPath.c_str(),
+                      strerror( error ) );
+          return WriteError( XRootDStatus( stError, errOSError, error ) );
+        }
         return XRootDStatus();
       }
 
@@ -993,7 +1889,10 @@ namespace
       //------------------------------------------------------------------------
       virtual XrdCl::XRootDStatus Flush()
       {
-        return XrdCl::XRootDStatus();
+        XrdCl::XRootDStatus st = Reap( 0 );
+        if( !st.IsOK() )
+          return WriteError( st );
+        return st;
       }
 
       //------------------------------------------------------------------------
@@ -1005,6 +1904,30 @@ namespace
         return XrdCl::Utils::GetLocalCheckSum( checkSum, checkSumType, pPath );
       }
 
+      //------------------------------------------------------------------------
+      //! Copy the next chunk of a local source into the file in the kernel,
+      //! the file is given up on if the copy fails
+      //!
+      //! @param  src the source
+      //! @param  ci  offset and length of the chunk, no buffer
+      //! @return     status of LocalSource::CopyChunk
+      //------------------------------------------------------------------------
+      XrdCl::XRootDStatus CopyChunk( LocalSource *src, XrdCl::ChunkInfo &ci )
+      {
+        using namespace XrdCl;
+        if( pFD == -1 )
+          return XRootDStatus( stError, errUninitialized );
+
+        XRootDStatus st = src->CopyChunk( pFD, ci );
+        if( st.IsOK() || st.code == errNotSupported )
+          return st;
+
+        Log *log = DefaultEnv::GetLog();
+        log->Debug( UtilityMsg, "Unable to copy to %s: %s", pPath.c_str(),
+                    st.ToStr().c_str() );
+        return WriteError( st );
+      }
+
       //------------------------------------------------------------------------
       //! Create a directory path
       //------------------------------------------------------------------------
@@ -1065,8 +1988,105 @@ namespace
       LocalDestination(const LocalDestination &other);
       LocalDestination &operator = (const LocalDestination &other);
 
-      std::string pPath;
-      int         pFD;
+      //------------------------------------------------------------------------
+      // A write queued in the ring
+      //------------------------------------------------------------------------
+      struct WriteRequest
+      {
+        WriteRequest( const XrdCl::ChunkInfo &ci ): offset( ci.offset )
+        {
+          iov.iov_base = ci.buffer;
+          iov.iov_len  = ci.length;
+        }
+
+        iovec    iov;
+        uint64_t offset;
+      };
+
+      //------------------------------------------------------------------------
+      // Write the whole buffer with blocking calls
+      //------------------------------------------------------------------------
+      int WriteAll( char *cursor, uint32_t length, uint64_t offset )
+      {
+        while( length )
+        {
+          int64_t wr = pwrite( pFD, cursor, length, offset );
+          if( wr == -1 )
+            return errno;
+          offset += wr;
+          cursor += wr;
+          length -= wr;
+        }
+        return 0;
+      }
+
+      //------------------------------------------------------------------------
+      // Wait until at most maxInFlight writes are in flight, short writes are
+      // completed with blocking calls
+      //------------------------------------------------------------------------
+      XrdCl::XRootDStatus Reap( uint32_t maxInFlight )
+      {
+        using namespace XrdCl;
+        Log *log = DefaultEnv::GetLog();
+        XRootDStatus st;
+        while( pInFlight > maxInFlight )
+        {
+          void    *data;
+          int32_t  result;
+          int error = pRing->Wait( data, result );
+          if( error )
+          {
+            //------------------------------------------------------------------
+            // The kernel may still read the buffers in flight, they are not
+            // given back
+            //------------------------------------------------------------------
+            pInFlight = 0;
+            return XRootDStatus( stError, errOSError, error );
+          }
+          --pInFlight;
+
+          WriteRequest *rq     = (WriteRequest*)data;
+          char         *buffer = (char*)rq->iov.iov_base;
+          uint32_t      length = rq->iov.iov_len;
+          if( result >= 0 && uint32_t( result ) < length )
+          {
+            DropDirectIO( pFD, pDirect, rq->offset + result, length - result );
+            result = -WriteAll( buffer + result, length - result,
+                                rq->offset + result );
+          }
+          if( result < 0 && st.IsOK() )
+          {
+            log->Debug( UtilityMsg, "Unable to write to %s: %s",
+                        pPath.c_str(), strerror( -result ) );
+            st = XRootDStatus( stError, errOSError, -result );
+          }
+          pPool->Put( buffer );
+          delete rq;
+        }
+        return st;
+      }
+
+      //------------------------------------------------------------------------
+      // Give up on the file after a failed write
+      //------------------------------------------------------------------------
+      XrdCl::XRootDStatus WriteError( const XrdCl::XRootDStatus &st )
+      {
+        Reap( 0 );
+        close( pFD );
+        pFD = -1;
+        if( pPosc )
+          unlink( pPath.c_str() );
+        return st;
+      }
+
+      std::string      pPath;
+      int              pFD;
+      uint32_t         pChunkSize;
+      uint8_t          pParallel;
+      uint32_t         pInFlight;
+      bool             pDirect;
+      ChunkBufferPool *pPool;
+      IORing          *pRing;
   };
 
   //----------------------------------------------------------------------------
@@ -1078,8 +2098,8 @@ namespace
       //------------------------------------------------------------------------
       //! Constructor
       //------------------------------------------------------------------------
-      StdOutDestination( const std::string &ckSumType ):
-        pCkSumHelper( "stdout", ckSumType ), pCurrentOffset(0)
+      StdOutDestination( const std::string &ckSumType, ChunkBufferPool *pool ):
+        pCkSumHelper( "stdout", ckSumType ), pCurrentOffset(0), pPool( pool )
       {
       }
 
@@ -1124,6 +2144,17 @@ namespace
           return XRootDStatus( stError, errInternal );
         }
 
+        //----------------------------------------------------------------------
+        // A stream has no holes, it gets the zeros
+        //----------------------------------------------------------------------
+        if( !ci.buffer )
+        {
+          ci.buffer = pPool->Get();
+          if( !ci.buffer )
+            return XRootDStatus( stError, errOSError, ENOMEM );
+          memset( ci.buffer, 0, ci.length );
+        }
+
         int64_t   wr     = 0;
         uint32_t  length = ci.length;
         char     *cursor = (char*)ci.buffer;
@@ -1134,7 +2165,7 @@ namespace
           {
             log->Debug( UtilityMsg, "Unable to write to stdout: %s",
                         strerror( errno ) );
-            delete [] (char*)ci.buffer; ci.buffer = 0;
+            pPool->Put( ci.buffer ); ci.buffer = 0;
             return XRootDStatus( stError, errOSError, errno );
           }
           pCurrentOffset += wr;
@@ -1144,7 +2175,7 @@ namespace
         while( length );
 
         pCkSumHelper.Update( ci.buffer, ci.length );
-        delete [] (char*)ci.buffer; ci.buffer = 0;
+        pPool->Put( ci.buffer ); ci.buffer = 0;
         return XRootDStatus();
       }
 
@@ -1168,8 +2199,9 @@ namespace
     private:
       StdOutDestination(const StdOutDestination &other);
       StdOutDestination &operator = (const StdOutDestination &other);
-      CheckSumHelper pCkSumHelper;
-      uint64_t       pCurrentOffset;
+      CheckSumHelper   pCkSumHelper;
+      uint64_t         pCurrentOffset;
+      ChunkBufferPool *pPool;
   };
 
   //----------------------------------------------------------------------------
@@ -1181,8 +2213,10 @@ namespace
       //------------------------------------------------------------------------
       //! Constructor
       //------------------------------------------------------------------------
-      XRootDDestination( const XrdCl::URL *url, uint8_t parallelChunks ):
-        pUrl( url ), pFile( new XrdCl::File() ), pParallel( parallelChunks )
+      XRootDDestination( const XrdCl::URL *url, uint8_t parallelChunks,
+                         ChunkBufferPool *pool ):
+        pUrl( url ), pFile( new XrdCl::File() ), pParallel( parallelChunks ),
+        pPool( pool )
       {
       }
 
@@ -1249,6 +2283,18 @@ namespace
         if( !pFile->IsOpen() )
           return XRootDStatus( stError, errUninitialized );
 
+        //----------------------------------------------------------------------
+        // The protocol has no holes and not every server accepts writes with
+        // gaps, holes are sent as zeros
+        //----------------------------------------------------------------------
+        if( !ci.buffer )
+        {
+          ci.buffer = pPool->Get();
+          if( !ci.buffer )
+            return XRootDStatus( stError, errOSError, ENOMEM );
+          memset( ci.buffer, 0, ci.length );
+        }
+
         //----------------------------------------------------------------------
         // If there is still place for this chunk to be sent send it
         //----------------------------------------------------------------------
@@ -1262,7 +2308,7 @@ namespace
         XRDCL_SMART_PTR_T<ChunkHandler> ch( pChunks.front() );
         pChunks.pop();
         ch->sem->Wait();
-        delete [] (char*)ch->chunk.buffer;
+        pPool->Put( ch->chunk.buffer );
         if( !ch->status.IsOK() )
         {
           Log *log = DefaultEnv::GetLog();
@@ -1285,7 +2331,7 @@ namespace
           ChunkHandler *ch = pChunks.front();
           pChunks.pop();
           ch->sem->Wait();
-          delete [] (char *)ch->chunk.buffer;
+          pPool->Put( ch->chunk.buffer );
           delete ch;
         }
       }
@@ -1301,7 +2347,7 @@ namespace
         if( !st.IsOK() )
         {
           CleanUpChunks();
-          delete [] (char*)ci.buffer;
+          pPool->Put( ci.buffer );
           ci.buffer = 0;
           delete ch;
           return st;
@@ -1323,7 +2369,7 @@ namespace
           ch->sem->Wait();
           if( !ch->status.IsOK() )
             st = ch->status;
-          delete [] (char *)ch->chunk.buffer;
+          pPool->Put( ch->chunk.buffer );
           delete ch;
         }
         return st;
@@ -1370,6 +2416,7 @@ namespace
       const XrdCl::URL           *pUrl;
       XrdCl::File                *pFile;
       uint8_t                     pParallel;
+      ChunkBufferPool            *pPool;
       std::queue<ChunkHandler *>  pChunks;
   };
 }
@@ -1414,32 +2461,57 @@ namespace XrdCl
     pProperties->Get( "makeDir",         makeDir );
     pProperties->Get( "dynamicSource",   dynamicSource );
 
+    int localDirectIO = DefaultCPLocalDirectIO;
+    DefaultEnv::GetEnv()->GetInt( "CPLocalDirectIO", localDirectIO );
+    int sparseFiles = DefaultCPSparseFiles;
+    DefaultEnv::GetEnv()->GetInt( "CPSparseFiles", sparseFiles );
+
+    //--------------------------------------------------------------------------
+    // The chunk buffers, enough for the chunks in flight at the source and at
+    // the destination plus the one being handed over. Declared before the
+    // source and the destination so that it outlives both.
+    //--------------------------------------------------------------------------
+    ChunkBufferPool pool( chunkSize, 2 * size_t( parallelChunks ) + 2 );
+
     //--------------------------------------------------------------------------
     // Initialize the source and the destination
     //--------------------------------------------------------------------------
     XRDCL_SMART_PTR_T<Source> src;
+    LocalSource *localSrc = 0;
     if( GetSource().GetProtocol() == "file" )
-      src.reset( new LocalSource( &GetSource(), checkSumType, chunkSize ) );
+    {
+      localSrc = new LocalSource( &GetSource(), checkSumType, chunkSize,
+                                  parallelChunks, localDirectIO, sparseFiles,
+                                  &pool );
+      src.reset( localSrc );
+    }
     else if( GetSource().GetProtocol() == "stdio" )
-      src.reset( new StdInSource( checkSumType, chunkSize ) );
+      src.reset( new StdInSource( checkSumType, chunkSize, &pool ) );
     else
     {
       if( dynamicSource )
-        src.reset( new XRootDSourceDynamic( &GetSource(), chunkSize ) );
+        src.reset( new XRootDSourceDynamic( &GetSource(), chunkSize,
+                                            parallelChunks, &pool ) );
       else
-        src.reset( new XRootDSource( &GetSource(), chunkSize, parallelChunks ) );
+        src.reset( new XRootDSource( &GetSource(), chunkSize, parallelChunks,
+                                     &pool ) );
     }
 
     XRootDStatus st = src->Initialize();
     if( !st.IsOK() ) return st;
 
     XRDCL_SMART_PTR_T<Destination> dest;
+    LocalDestination *localDest = 0;
     URL newDestUrl( GetTarget() );
 
     if( GetTarget().GetProtocol() == "file" )
-      dest.reset( new LocalDestination( &GetTarget() ) );
+    {
+      localDest = new LocalDestination( &GetTarget(), chunkSize,
+                                        parallelChunks, localDirectIO, &pool );
+      dest.reset( localDest );
+    }
     else if( GetTarget().GetProtocol() == "stdio" )
-      dest.reset( new StdOutDestination( checkSumType ) );
+      dest.reset( new StdOutDestination( checkSumType, &pool ) );
     //--------------------------------------------------------------------------
     // For xrootd destination build the oss.asize hint
     //--------------------------------------------------------------------------
@@ -1453,7 +2525,7 @@ namespace XrdCl
         newDestUrl.SetParams( params );
  //     makeDir = true; // Backward compatability for xroot destinations!!!
       }
-      dest.reset( new XRootDDestination( &newDestUrl, parallelChunks ) );
+      dest.reset( new XRootDDestination( &newDestUrl, parallelChunks, &pool ) );
     }
 
     dest->SetForce( force );
@@ -1464,21 +2536,34 @@ namespace XrdCl
     if( !st.IsOK() ) return st;
 
     //--------------------------------------------------------------------------
-    // Copy the chunks
+    // Copy the chunks, between two local files in the kernel as long as it
+    // can copy between them
     //--------------------------------------------------------------------------
     ChunkInfo chunkInfo;
-    uint64_t  size      = src->GetSize() >= 0 ? src->GetSize() : 0;
-    uint64_t  processed = 0;
+    uint64_t  size       = src->GetSize() >= 0 ? src->GetSize() : 0;
+    uint64_t  processed  = 0;
+    bool      kernelCopy = localSrc && localDest;
     while( 1 )
     {
-      st = src->GetChunk( chunkInfo );
+      if( kernelCopy )
+      {
+        st = localDest->CopyChunk( localSrc, chunkInfo );
+        if( !st.IsOK() && st.code == errNotSupported )
+        {
+          kernelCopy = false;
+          continue;
+        }
+      }
+      else
+        st = src->GetChunk( chunkInfo );
       if( !st.IsOK() )
         return st;
 
       if( st.IsOK() && st.code == suDone )
         break;
 
-      st = dest->PutChunk( chunkInfo );
+      if( !kernelCopy )
+        st = dest->PutChunk( chunkInfo );
 
       if( !st.IsOK() )
         return st;
@@ -64,6 +64,9 @@ namespace XrdCl
   const int DefaultTCPKeepAliveProbes   = 9;
   const int DefaultMultiProtocol        = 0;
   const int DefaultParallelEvtLoop      = 1;
+  const int DefaultDirListLocateWindow  = 16;
+  const int DefaultCPLocalDirectIO      = 0;
+  const int DefaultCPSparseFiles        = 1;
 
   const char * const DefaultPollerPreference   = "built-in";
   const char * const DefaultNetworkStack       = "IPAuto";
@@ -201,6 +201,9 @@ namespace XrdCl
     REGISTER_VAR_INT( varsInt, "TCPKeepProbes",        DefaultTCPKeepAliveProbes   );
     REGISTER_VAR_INT( varsInt, "MultiProtocol",        DefaultMultiProtocol        );
     REGISTER_VAR_INT( varsInt, "ParallelEvtLoop",      DefaultParallelEvtLoop      );
+    REGISTER_VAR_INT( varsInt, "DirListLocateWindow",  DefaultDirListLocateWindow  );
+    REGISTER_VAR_INT( varsInt, "CPLocalDirectIO",      DefaultCPLocalDirectIO      );
+    REGISTER_VAR_INT( varsInt, "CPSparseFiles",        DefaultCPSparseFiles        );
 
     REGISTER_VAR_STR( varsStr, "PollerPreference",     DefaultPollerPreference     );
     REGISTER_VAR_STR( varsStr, "ClientMonitor",        DefaultClientMonitor        );
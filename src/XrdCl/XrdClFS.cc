@@ -32,11 +32,13 @@
 #include "XrdCl/XrdClUtils.hh"
 #include "XrdCl/XrdClCopyProcess.hh"
 #include "XrdCl/XrdClFile.hh"
+#include "XrdSys/XrdSysPthread.hh"
 
 #include <cstdlib>
 #include <cstdio>
 #include <iostream>
 #include <iomanip>
+#include <deque>
 
 #ifdef HAVE_READLINE
 #include <readline/readline.h>
@@ -197,6 +199,191 @@ XRootDStatus DoCD( FileSystem                      *fs,
   return XRootDStatus();
 }
 
+//------------------------------------------------------------------------------
+// Print a directory listing entry
+//------------------------------------------------------------------------------
+void PrintListEntry( DirectoryList::ListEntry *entry,
+                     const std::string        &parent,
+                     bool                      stats,
+                     bool                      showUrls )
+{
+  if( stats )
+  {
+    StatInfo *info = entry->GetStatInfo();
+    if( !info )
+    {
+      std::cout << "---- 0000-00-00 00:00:00            ? ";
+    }
+    else
+    {
+      if( info->TestFlags( StatInfo::IsDir ) )
+        std::cout << "d";
+      else
+        std::cout << "-";
+
+      if( info->TestFlags( StatInfo::IsReadable ) )
+        std::cout << "r";
+      else
+        std::cout << "-";
+
+      if( info->TestFlags( StatInfo::IsWritable ) )
+        std::cout << "w";
+      else
+        std::cout << "-";
+
+      if( info->TestFlags( StatInfo::XBitSet ) )
+        std::cout << "x";
+      else
+        std::cout << "-";
+
+      std::cout << " " << info->GetModTimeAsString();
+
+      std::cout << std::setw(12) << info->GetSize() << " ";
+    }
+  }
+  if( showUrls )
+    std::cout << "root://" << entry->GetHostAddress() << "/";
+  std::cout << parent << entry->GetName() << std::endl;
+}
+
+//------------------------------------------------------------------------------
+// Recursive directory walker: keeps up to fanOut directory listings in
+// flight and prints the entries of every directory as soon as its listing
+// arrives, so the output of different directories may interleave in any
+// order
+//------------------------------------------------------------------------------
+class DirWalker
+{
+  public:
+    DirWalker( FileSystem *fs, uint32_t fanOut, bool stats, bool showUrls ):
+      pFS( fs ), pFanOut( fanOut ? fanOut : 1 ), pStats( stats ),
+      pShowUrls( showUrls ), pInFlight( 0 ), pFailed( 0 ), pCond( 0 ) {}
+
+    //--------------------------------------------------------------------------
+    // Walk the tree below path, returns when all the listings are done
+    //--------------------------------------------------------------------------
+    XRootDStatus Walk( const std::string &path )
+    {
+      XrdSysCondVarHelper scopedLock( &pCond );
+      pPending.push_back( path );
+      while( !pPending.empty() || pInFlight )
+      {
+        if( pPending.empty() || pInFlight >= pFanOut )
+        {
+          pCond.Wait();
+          continue;
+        }
+        std::string dir = pPending.front();
+        pPending.pop_front();
+        ++pInFlight;
+        pCond.UnLock();
+        ListHandler  *handler = new ListHandler( this, dir );
+        XRootDStatus  st      = pFS->DirList( dir, DirListFlags::Locate |
+                                                   DirListFlags::Stat,
+                                              handler );
+        pCond.Lock();
+        if( !st.IsOK() )
+        {
+          delete handler;
+          --pInFlight;
+          pCond.UnLock();
+          Failed( dir, st );
+          pCond.Lock();
+        }
+      }
+
+      if( pFailed )
+        return XRootDStatus( stOK, suPartial );
+      return XRootDStatus();
+    }
+
+  private:
+    //--------------------------------------------------------------------------
+    // Hands the listing back to the walker
+    //--------------------------------------------------------------------------
+    class ListHandler: public ResponseHandler
+    {
+      public:
+        ListHandler( DirWalker *walker, const std::string &path ):
+          pWalker( walker ), pPath( path ) {}
+
+        virtual void HandleResponse( XRootDStatus *status,
+                                     AnyObject    *response )
+        {
+          DirectoryList *list = 0;
+          if( status->IsOK() && response )
+            response->Get( list );
+          if( list )
+            pWalker->Listed( status->code == suPartial ? pPath : "", list );
+          else
+            pWalker->Failed( pPath, *status );
+          delete status;
+          delete response;
+          DirWalker *walker = pWalker;
+          delete this;
+          walker->Done();
+        }
+
+      private:
+        DirWalker   *pWalker;
+        std::string  pPath;
+    };
+
+    //--------------------------------------------------------------------------
+    // Print the entries and queue the subdirectories
+    //--------------------------------------------------------------------------
+    void Listed( const std::string &partial, DirectoryList *list )
+    {
+      std::deque<std::string> subdirs;
+      {
+        XrdSysMutexHelper scopedLock( pPrintMutex );
+        if( !partial.empty() )
+        {
+          std::cerr << "[!] Some of the requests failed. The listing of ";
+          std::cerr << partial << " may be incomplete." << std::endl;
+        }
+        DirectoryList::Iterator it;
+        for( it = list->Begin(); it != list->End(); ++it )
+        {
+          PrintListEntry( *it, list->GetParentName(), pStats, pShowUrls );
+          StatInfo *info = (*it)->GetStatInfo();
+          if( info && info->TestFlags( StatInfo::IsDir ) )
+            subdirs.push_back( list->GetParentName() + (*it)->GetName() );
+        }
+      }
+      XrdSysCondVarHelper scopedLock( &pCond );
+      pPending.insert( pPending.end(), subdirs.begin(), subdirs.end() );
+    }
+
+    //--------------------------------------------------------------------------
+    // A listing is done, the walker may send the next one
+    //--------------------------------------------------------------------------
+    void Done()
+    {
+      XrdSysCondVarHelper scopedLock( &pCond );
+      --pInFlight;
+      pCond.Signal();
+    }
+
+    void Failed( const std::string &path, const XRootDStatus &st )
+    {
+      XrdSysMutexHelper scopedLock( pPrintMutex );
+      std::cerr << "[!] Unable to list " << path << ": " << st.ToStr();
+      std::cerr << std::endl;
+      ++pFailed;
+    }
+
+    FileSystem              *pFS;
+    uint32_t                 pFanOut;
+    bool                     pStats;
+    bool                     pShowUrls;
+    uint32_t                 pInFlight;
+    uint32_t                 pFailed;
+    std::deque<std::string>  pPending;
+    XrdSysCondVar            pCond;
+    XrdSysMutex              pPrintMutex;
+};
+
 //------------------------------------------------------------------------------
 // List a directory
 //------------------------------------------------------------------------------
@@ -211,10 +398,12 @@ XRootDStatus DoLS( FileSystem                      *fs,
   uint32_t    argc     = args.size();
   bool        stats    = false;
   bool        showUrls = false;
+  bool        recurse  = false;
+  uint32_t    fanOut   = 16;
   std::string path;
   DirListFlags::Flags flags = DirListFlags::Locate;
 
-  if( argc > 5 )
+  if( argc > 7 )
   {
     log->Error( AppMsg, "Too many arguments." );
     return XRootDStatus( stError, errInvalidArgs );
@@ -229,6 +418,19 @@ XRootDStatus DoLS( FileSystem                      *fs,
     }
     else if( args[i] == "-u" )
       showUrls = true;
+    else if( args[i] == "-R" )
+      recurse = true;
+    else if( args[i] == "-j" )
+    {
+      char *end = 0;
+      if( i+1 < args.size() )
+        fanOut = strtoul( args[++i].c_str(), &end, 10 );
+      if( !end || *end || !fanOut )
+      {
+        log->Error( AppMsg, "Invalid arguments. Expected a number after -j." );
+        return XRootDStatus( stError, errInvalidArgs );
+      }
+    }
     else
       path = args[i];
   }
@@ -247,6 +449,21 @@ XRootDStatus DoLS( FileSystem                      *fs,
 
   log->Debug( AppMsg, "Attempting to list: %s", newPath.c_str() );
 
+  //----------------------------------------------------------------------------
+  // Walk the tree
+  //----------------------------------------------------------------------------
+  if( recurse )
+  {
+    DirWalker walker( fs, fanOut, stats, showUrls );
+    XRootDStatus st = walker.Walk( newPath );
+    if( st.code == suPartial )
+    {
+      std::cerr << "[!] Some of the directories could not be listed. The ";
+      std::cerr << "result may be incomplete." << std::endl;
+    }
+    return st;
+  }
+
   //----------------------------------------------------------------------------
   // Ask for the list
   //----------------------------------------------------------------------------
@@ -269,45 +486,7 @@ XRootDStatus DoLS( FileSystem                      *fs,
   //----------------------------------------------------------------------------
   DirectoryList::Iterator it;
   for( it = list->Begin(); it != list->End(); ++it )
-  {
-    if( stats )
-    {
-      StatInfo *info = (*it)->GetStatInfo();
-      if( !info )
-      {
-        std::cout << "---- 0000-00-00 00:00:00            ? ";
-      }
-      else
-      {
-        if( info->TestFlags( StatInfo::IsDir ) )
-          std::cout << "d";
-        else
-          std::cout << "-";
-
-        if( info->TestFlags( StatInfo::IsReadable ) )
-          std::cout << "r";
-        else
-          std::cout << "-";
-
-        if( info->TestFlags( StatInfo::IsWritable ) )
-          std::cout << "w";
-        else
-          std::cout << "-";
-
-        if( info->TestFlags( StatInfo::XBitSet ) )
-          std::cout << "x";
-        else
-          std::cout << "-";
-
-        std::cout << " " << info->GetModTimeAsString();
-
-        std::cout << std::setw(12) << info->GetSize() << " ";
-      }
-    }
-    if( showUrls )
-      std::cout << "root://" << (*it)->GetHostAddress() << "/";
-    std::cout << list->GetParentName() << (*it)->GetName() << std::endl;
-  }
+    PrintListEntry( *it, list->GetParentName(), stats, showUrls );
   delete list;
   return XRootDStatus();
 }
@@ -1466,10 +1645,14 @@ XRootDStatus PrintHelp( FileSystem *, Env *,
   printf( "     Modify permissions. Permission string example:\n"           );
   printf( "     rwxr-x--x\n\n"                                              );
 
-  printf( "   ls [-l] [-u] [dirname]\n"                                     );
+  printf( "   ls [-l] [-u] [-R [-j <n>]] [dirname]\n"                       );
   printf( "     Get directory listing.\n"                                   );
   printf( "     -l stat every entry and pring long listing\n"               );
-  printf( "     -u print paths as URLs\n\n"                                 );
+  printf( "     -u print paths as URLs\n"                                   );
+  printf( "     -R list the subdirectories recursively, the entries are\n"  );
+  printf( "        printed as the listings arrive\n"                        );
+  printf( "     -j number of directories listed in parallel with -R,\n"     );
+  printf( "        16 by default\n\n"                                       );
 
   printf( "   locate [-n] [-r] [-d] <path>\n"                               );
   printf( "     Get the locations of the path.\n"                           );
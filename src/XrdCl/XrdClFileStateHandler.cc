@@ -552,9 +552,10 @@ namespace XrdCl
       return XRootDStatus( stError, errInvalidOp );
 
     //--------------------------------------------------------------------------
-    // Return the cached info
+    // Return the cached info, a server that did not honour kXR_retstat on
+    // open leaves nothing to return, ask it then and cache the answer
     //--------------------------------------------------------------------------
-    if( !force )
+    if( !force && pStatInfo )
     {
       AnyObject *obj = new AnyObject();
       obj->Set( new StatInfo( *pStatInfo ) );
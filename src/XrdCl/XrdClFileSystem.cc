@@ -37,6 +37,8 @@
 #include "XrdSys/XrdSysPthread.hh"
 
 #include <memory>
+#include <map>
+#include <vector>
 
 namespace
 {
@@ -293,6 +295,124 @@ namespace
       uint32_t                  pIndex;
       XrdCl::RequestSync   *pSync;
   };
+
+  //----------------------------------------------------------------------------
+  // Merge the directory list of one of the servers into the common one
+  //----------------------------------------------------------------------------
+  class DirListMergeHandler: public XrdCl::ResponseHandler
+  {
+    public:
+      //------------------------------------------------------------------------
+      // Constructor, takes over the file system of the server
+      //------------------------------------------------------------------------
+      DirListMergeHandler( XrdCl::FileSystem    *fs,
+                           XrdCl::DirectoryList *list,
+                           XrdSysMutex          *mutex,
+                           bool                 *partial,
+                           XrdCl::XRootDStatus  *lastError,
+                           XrdCl::RequestSync   *sync ):
+        pFS( fs ),
+        pList( list ),
+        pMutex( mutex ),
+        pPartial( partial ),
+        pLastError( lastError ),
+        pSync( sync )
+      {
+      }
+
+      virtual ~DirListMergeHandler()
+      {
+        delete pFS;
+      }
+
+      //------------------------------------------------------------------------
+      // Move the entries over, the sync has to be notified last as the
+      // waiting thread goes away with the shared state
+      //------------------------------------------------------------------------
+      virtual void HandleResponse( XrdCl::XRootDStatus *status,
+                                   XrdCl::AnyObject    *response )
+      {
+        XrdCl::DirectoryList *list = 0;
+        if( status->IsOK() && response )
+          response->Get( list );
+
+        bool success = list != 0;
+        {
+          XrdSysMutexHelper scopedLock( pMutex );
+          if( !success )
+            *pLastError = status->IsOK() ?
+                          XrdCl::XRootDStatus( XrdCl::stError,
+                                               XrdCl::errInternal ) : *status;
+          else
+          {
+            if( status->code == XrdCl::suPartial )
+              *pPartial = true;
+            XrdCl::DirectoryList::Iterator it;
+            for( it = list->Begin(); it != list->End(); ++it )
+            {
+              pList->Add( *it );
+              *it = 0;
+            }
+          }
+        }
+        delete status;
+        delete response;
+        XrdCl::RequestSync *sync = pSync;
+        delete this;
+        sync->TaskDone( success );
+      }
+
+    private:
+      XrdCl::FileSystem    *pFS;
+      XrdCl::DirectoryList *pList;
+      XrdSysMutex          *pMutex;
+      bool                 *pPartial;
+      XrdCl::XRootDStatus  *pLastError;
+      XrdCl::RequestSync   *pSync;
+  };
+
+  //----------------------------------------------------------------------------
+  // Stat the entries of a merged list that have no stat info yet, each at
+  // the server it was listed by
+  //----------------------------------------------------------------------------
+  bool StatMissingEntries( XrdCl::DirectoryList *list, uint16_t timeout )
+  {
+    std::vector<uint32_t> missing;
+    for( uint32_t i = 0; i < list->GetSize(); ++i )
+      if( !list->At( i )->GetStatInfo() )
+        missing.push_back( i );
+    if( missing.empty() )
+      return true;
+
+    std::map<std::string, XrdCl::FileSystem*>           servers;
+    std::map<std::string, XrdCl::FileSystem*>::iterator itS;
+    uint32_t quota = missing.size() <= 1024 ? missing.size() : 1024;
+    XrdCl::RequestSync sync( missing.size(), quota );
+    for( uint32_t i = 0; i < missing.size(); ++i )
+    {
+      XrdCl::DirectoryList::ListEntry *entry = list->At( missing[i] );
+      itS = servers.find( entry->GetHostAddress() );
+      if( itS == servers.end() )
+        itS = servers.insert( std::make_pair( entry->GetHostAddress(),
+                  new XrdCl::FileSystem( entry->GetHostAddress() ) ) ).first;
+
+      std::string fullPath = list->GetParentName() + entry->GetName();
+      XrdCl::ResponseHandler *handler =
+        new DirListStatHandler( list, missing[i], &sync );
+      XrdCl::XRootDStatus st = itS->second->Stat( fullPath, handler, timeout );
+      if( !st.IsOK() )
+      {
+        sync.TaskDone( false );
+        delete handler;
+      }
+      sync.WaitForQuota();
+    }
+    sync.WaitForAll();
+
+    for( itS = servers.begin(); itS != servers.end(); ++itS )
+      delete itS->second;
+    return sync.FailureCount() == 0;
+  }
 }
 
 namespace XrdCl
@@ -955,53 +1075,64 @@ namespace XrdCl
       }
 
       //------------------------------------------------------------------------
-      // Ask each server for a directory list
+      // Ask the servers for their directory lists, a window of them at a
+      // time, and merge the lists as they come
       //------------------------------------------------------------------------
       flags &= ~DirListFlags::Locate;
-      FileSystem    *fs;
-      DirectoryList *currentResp  = 0;
-      uint32_t       errors       = 0;
       uint32_t       numLocations = locations->GetSize();
       bool           partial      = st.code == suPartial ? true : false;
+      XRootDStatus   lastError;
+      XrdSysMutex    mutex;
+      int            window       = DefaultDirListLocateWindow;
+      DefaultEnv::GetEnv()->GetInt( "DirListLocateWindow", window );
+      uint32_t       quota        = window > 0 ? window : 1;
+      if( quota > numLocations )
+        quota = numLocations;
 
       response = new DirectoryList();
       response->SetParentName( path );
 
-      for( uint32_t i = 0; i < locations->GetSize(); ++i )
+      RequestSync sync( numLocations, quota );
+      for( uint32_t i = 0; i < numLocations; ++i )
       {
-        fs = new FileSystem( locations->At(i).GetAddress() );
-        st = fs->DirList( path, flags, currentResp, timeout );
+        FileSystem      *fs      = new FileSystem(
+                                       locations->At(i).GetAddress() );
+        ResponseHandler *handler = new DirListMergeHandler( fs, response,
+                                                            &mutex, &partial,
+                                                            &lastError, &sync );
+        st = fs->DirList( path, flags, handler, timeout );
         if( !st.IsOK() )
         {
-          ++errors;
-          delete fs;
-          continue;
-        }
-
-        if( st.code == suPartial )
-          partial = true;
-
-        DirectoryList::Iterator it;
-
-        for( it = currentResp->Begin(); it != currentResp->End(); ++it )
-        {
-          response->Add( *it );
-          *it = 0;
+          {
+            XrdSysMutexHelper scopedLock( mutex );
+            lastError = st;
+          }
+          delete handler;
+          sync.TaskDone( false );
         }
-
-        delete fs;
-        delete currentResp;
-        fs          = 0;
-        currentResp = 0;
+        sync.WaitForQuota();
       }
+      sync.WaitForAll();
       delete locations;
 
-      if( errors || partial )
+      uint32_t errors = sync.FailureCount();
+      if( errors == numLocations )
       {
-        if( errors == numLocations )
-          return st;
-        return XRootDStatus( stOK, suPartial );
+        delete response;
+        response = 0;
+        return lastError;
       }
+
+      //------------------------------------------------------------------------
+      // The servers not supporting the bulk stat leave the entries without
+      // stat info, ask the server holding the entry
+      //------------------------------------------------------------------------
+      if( (flags & DirListFlags::Stat) &&
+          !StatMissingEntries( response, timeout ) )
+        partial = true;
+
+      if( errors || partial )
+        return XRootDStatus( stOK, suPartial );
       return XRootDStatus();
     };
 